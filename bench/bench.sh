@@ -0,0 +1,98 @@
+#!/bin/bash
+# Benchmark suite: run from the repository root (see make bench), on the
+# binaries in $BIN, the tree's own by default.
+
+. "$(dirname "$0")/corpus.sh"
+bin=$(cd "${BIN:-.}" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# best wall time of three runs in ms, also left in $best; output goes to a
+# file because GNU grep stops at the first match when it sees /dev/null
+run_bench() {
+	local name=$1
+	best=""
+	shift
+	for _ in 1 2 3; do
+		local start end elapsed
+		start=$(date +%s%N)
+		"$@" > "$work/out" 2>&1
+		end=$(date +%s%N)
+		elapsed=$(((end - start) / 1000000))
+		if [ -z "$best" ] || ((elapsed < best)); then best=$elapsed; fi
+	done
+	printf "%-40s %8d ms\n" "$name" "$best"
+}
+
+echo "== pattern startup (-f) =="
+for count in 1000 10000 100000; do
+	corpus_patterns $count "$work/patterns"
+	run_bench "s21_grep -f $count patterns" "$bin/s21_grep" -c -f "$work/patterns" /dev/null
+	run_bench "grep -E -f $count patterns" grep -E -c -f "$work/patterns" /dev/null
+done
+
+echo "== many small files =="
+small_files=${SMALL_FILES:-100000}
+corpus_small "$small_files" "$work/small"
+(
+	cd "$work/small" || exit 1
+	for io in sync threads uring; do
+		run_bench "s21_grep --io=$io $small_files files" "$bin/s21_grep" --io=$io -c timeout -- *
+		printf "%-40s %8d files/s\n" "" $((small_files * 1000 / (best > 0 ? best : 1)))
+	done
+	run_bench "grep $small_files files" grep -c timeout -- *
+)
+
+echo "== inverted search (-v) =="
+corpus_noise 2000000 "$work/noise"
+for pattern in DEBUG ERROR; do
+	run_bench "s21_grep -v $pattern" "$bin/s21_grep" -v $pattern "$work/noise"
+	run_bench "grep -v $pattern" grep -v $pattern "$work/noise"
+	run_bench "s21_grep -vc $pattern" "$bin/s21_grep" -vc $pattern "$work/noise"
+	run_bench "grep -vc $pattern" grep -vc $pattern "$work/noise"
+done
+
+echo "== per-pattern counts =="
+# monitoring counts each signature: once per pattern, or in one run
+signatures=(-e ERROR -e DEBUG -e failed -e 'seq=1[0-9]*5$' -e 'request 7' -e heartbeat
+	-e 'ok seq' -e '^1[0-9]* ' -e 'seq=99' -e timeout)
+once_per_pattern() {
+	for ((i = 1; i < ${#signatures[@]}; i += 2)); do
+		"$bin/s21_grep" -c -e "${signatures[i]}" "$work/noise"
+	done
+}
+run_bench "s21_grep -c, once per pattern (10)" once_per_pattern
+run_bench "s21_grep --count-by-pattern (10)" "$bin/s21_grep" --count-by-pattern "${signatures[@]}" "$work/noise"
+
+echo "== resident daemon =="
+# the same -f pattern set searched again and again, each time by a new
+# process or by one the daemon answers with its compiled patterns
+corpus_patterns 10000 "$work/patterns"
+head -50 "$work/noise" > "$work/recent"
+socket="$work/daemon.sock"
+"$bin/s21_grep" --daemon="$socket" &
+daemon=$!
+for _ in $(seq 50); do [ -S "$socket" ] && break; sleep 0.1; done
+repeat() {
+	for _ in $(seq 20); do "$@" -c -f "$work/patterns" "$work/recent"; done
+}
+run_bench "s21_grep, 20 runs" repeat "$bin/s21_grep"
+run_bench "s21_grep --server, 20 runs" repeat "$bin/s21_grep" --server="$socket"
+kill $daemon
+
+echo "== cat across many files =="
+# from a cold page cache when it can be dropped (as root), else a warm one
+segments=${SEGMENTS:-2000}
+corpus_segments "$segments" "$work/segments"
+cold() {
+	sync
+	echo 3 > /proc/sys/vm/drop_caches 2> /dev/null
+	"$@"
+}
+(
+	cd "$work/segments" || exit 1
+	for ahead in 0 4 16 64; do
+		run_bench "s21_cat -n --read-ahead=$ahead $segments files" cold "$bin/s21_cat" -n --read-ahead=$ahead -- *
+	done
+	run_bench "cat -n $segments files" cold cat -n -- *
+)
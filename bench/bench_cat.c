@@ -0,0 +1,123 @@
+// Cat kernel benchmark: runs every valid flag combination through the
+// generic transform, which tests the flags per byte, and through the
+// kernel specialized for that combination, and checks that they agree
+// and that no kernel is slower than the generic transform. Combinations
+// that s21c_init leaves on the generic transform are only checked for
+// agreement.
+//   usage: bench_cat [MiB]
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "s21_cat_lib.h"
+
+// the best of RUNS runs is compared; a kernel below SLACK times the
+// generic speed is slower, above it is noise
+#define RUNS 7
+#define SLACK 0.95
+
+static char out[S21C_BLOCK_SIZE];
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Transforms the whole buffer and returns a checksum of the output.
+static unsigned long long run(int flags, int generic, const char *buffer,
+                              size_t len, double *seconds, int *specialized) {
+  unsigned long long sum = 0;
+  s21c_transformer t;
+  size_t consumed, n;
+  double t0 = now();
+
+  s21c_init(&t, flags);
+  *specialized = t.kernel != s21c_transform_generic;
+  while (len) {
+    n = generic ? s21c_transform_generic(&t, buffer, len, &consumed, out,
+                                         sizeof(out))
+                : s21c_transform(&t, buffer, len, &consumed, out, sizeof(out));
+    sum = sum * 31 + n + (n ? (unsigned char)out[n - 1] : 0);
+    buffer += consumed;
+    len -= consumed;
+  }
+  *seconds = now() - t0;
+
+  return sum;
+}
+
+static void describe(int flags, char *name) {
+  // u is --utf8
+  static const char letters[] = "nbsvETu";
+
+  *name++ = '-';
+  for (int i = 0; i < 7; i++)
+    if (flags & (1 << i)) *name++ = letters[i];
+  if (!flags) *name++ = '-';
+  *name = '\0';
+}
+
+int main(int argc, char *argv[]) {
+  size_t len = (size_t)(argc > 1 ? atoi(argv[1]) : 64) << 20;
+  char *buffer = malloc(len), name[16];
+  double generic_total = 0, kernel_total = 0, worst = 1e9, best = 0;
+  int slower = 0;
+
+  if (!buffer) return 1;
+  srand(21);
+  for (size_t i = 0; i < len; i++) {
+    int r = rand() % 100;
+    buffer[i] = r < 2    ? '\n'
+                : r < 4  ? '\t'
+                : r == 4 ? rand() % 32
+                : r == 5 ? 128 + rand() % 128
+                         : ' ' + rand() % 95;
+    // runs of blank lines for -s and -b
+    if (r == 0 && i + 3 < len) buffer[++i] = '\n', buffer[++i] = '\n';
+  }
+
+  printf("%zu MiB\n", len >> 20);
+  printf("%-8s %12s %12s %8s\n", "flags", "generic MB/s", "kernel MB/s",
+         "speedup");
+  for (int flags = 0; flags < S21C_KERNEL_COUNT; flags++) {
+    if ((flags & S21C_NUMBER) && (flags & S21C_NUMBER_NONBLANK)) continue;
+    if ((flags & S21C_UTF8) && !(flags & S21C_NONPRINT)) continue;
+    double generic = 1e9, kernel = 1e9, seconds, kernel_seconds;
+    int specialized;
+    describe(flags, name);
+    // alternated, so a slow spell of the machine hits both
+    for (int i = 0; i < RUNS; i++) {
+      if (run(flags, 1, buffer, len, &seconds, &specialized) !=
+          run(flags, 0, buffer, len, &kernel_seconds, &specialized)) {
+        printf("%s: kernels disagree\n", name);
+        return 1;
+      }
+      if (seconds < generic) generic = seconds;
+      if (kernel_seconds < kernel) kernel = kernel_seconds;
+    }
+    if (!specialized) {
+      printf("%-8s %12.0f %12s\n", name, len / generic / 1e6, "generic");
+      continue;
+    }
+    printf("%-8s %12.0f %12.0f %7.2fx%s\n", name, len / generic / 1e6,
+           len / kernel / 1e6, generic / kernel,
+           generic / kernel < SLACK ? " slower" : "");
+    slower += generic / kernel < SLACK;
+    generic_total += generic;
+    kernel_total += kernel;
+    if (generic / kernel < worst) worst = generic / kernel;
+    if (generic / kernel > best) best = generic / kernel;
+  }
+  printf("kernels %.2fx faster in total, per combination %.2fx to %.2fx\n",
+         generic_total / kernel_total, worst, best);
+  if (slower) printf("%d kernels slower than the generic transform\n", slower);
+
+  free(buffer);
+
+  return slower != 0;
+}
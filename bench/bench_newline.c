@@ -0,0 +1,71 @@
+// Newline kernel microbenchmark: counts and locates every newline of a
+// generated buffer with each SIMD level the CPU supports.
+//   usage: bench_newline [average line length] [MiB]
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "s21_simd.h"
+
+static const char *names[] = {"scalar", "sse2", "avx2", "avx512"};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t locate_all(int level, const char *buffer, size_t len) {
+  size_t count = 0;
+  const char *end = buffer + len, *nl;
+
+  while (buffer < end && (nl = level < 0 ? memchr(buffer, '\n', end - buffer)
+                                         : s21_find_newline_at(level, buffer, end - buffer))) {
+    count++;
+    buffer = nl + 1;
+  }
+
+  return count;
+}
+
+int main(int argc, char *argv[]) {
+  int line_len = argc > 1 ? atoi(argv[1]) : 80;
+  size_t len = (size_t)(argc > 2 ? atoi(argv[2]) : 64) << 20;
+  char *buffer = malloc(len);
+  size_t expected = 0;
+
+  if (!buffer || line_len < 1) return 1;
+  srand(21);
+  for (size_t i = 0; i < len; i++) {
+    buffer[i] = rand() % (2 * line_len) ? 'a' + i % 26 : '\n';
+    expected += buffer[i] == '\n';
+  }
+
+  printf("%zu MiB, %zu newlines\n", len >> 20, expected);
+  printf("%-8s %12s %12s\n", "variant", "count GB/s", "locate GB/s");
+  for (int level = -1; level <= S21_SIMD_AVX512; level++) {
+    if (level >= 0 && !s21_simd_supported(level)) continue;
+    double t0 = now();
+    size_t counted = level < 0 ? expected : s21_count_newlines_at(level, buffer, len);
+    double t1 = now();
+    size_t located = locate_all(level, buffer, len);
+    double t2 = now();
+    if (counted != expected || located != expected) {
+      printf("%s: wrong result\n", level < 0 ? "memchr" : names[level]);
+      return 1;
+    }
+    if (level < 0)
+      printf("%-8s %12s %12.2f\n", "memchr", "-", len / (t2 - t1) / 1e9);
+    else
+      printf("%-8s %12.2f %12.2f\n", names[level], len / (t1 - t0) / 1e9,
+             len / (t2 - t1) / 1e9);
+  }
+
+  free(buffer);
+
+  return 0;
+}
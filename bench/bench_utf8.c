@@ -0,0 +1,171 @@
+// UTF-8 benchmark: the ASCII kernels at each SIMD level, cat -v with and
+// without --utf8, and searches in a UTF-8 locale with the ASCII fast path
+// against plain multibyte regexec, with the C locale as the baseline. The
+// corpora are log lines that are all ASCII, and the same lines with one in
+// four carrying UTF-8 text.
+//   usage: bench_utf8 [MiB]
+
+#define _GNU_SOURCE
+
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "s21_cat_lib.h"
+#include "s21_grep_lib.h"
+#include "s21_simd.h"
+
+// the best of RUNS runs is reported
+#define RUNS 3
+
+static const char *names[] = {"scalar", "sse2", "avx2", "avx512"};
+static char out[S21C_BLOCK_SIZE];
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t make_corpus(char *buffer, size_t len, int mixed) {
+  static const char *words[] = {"запрос", "café", "日本語", "naïve"};
+  size_t used = 0;
+
+  for (long i = 0; used + 128 < len; i++) {
+    if (i % 20 == 0)
+      used += sprintf(buffer + used, "%ld ERROR request %ld failed", i, i);
+    else
+      used += sprintf(buffer + used, "%ld DEBUG heartbeat ok seq=%ld", i, i);
+    if (mixed && i % 4 == 0) used += sprintf(buffer + used, " %s", words[i / 4 % 4]);
+    buffer[used++] = '\n';
+  }
+
+  return used;
+}
+
+static void bench_kernels(const char *buffer, size_t len) {
+  printf("%-8s %12s %12s\n", "kernel", "ascii GB/s", "print GB/s");
+  for (int level = S21_SIMD_SCALAR; level <= S21_SIMD_AVX512; level++) {
+    if (!s21_simd_supported(level)) continue;
+    double t0 = now();
+    size_t ascii = s21_ascii_prefix_at(level, buffer, len);
+    double t1 = now();
+    size_t printable = s21_printable_prefix_at(level, buffer, len);
+    double t2 = now();
+    if (ascii != len || printable != len) {
+      printf("%s: wrong result\n", names[level]);
+      exit(1);
+    }
+    printf("%-8s %12.2f %12.2f\n", names[level], len / (t1 - t0) / 1e9,
+           len / (t2 - t1) / 1e9);
+  }
+}
+
+static double cat_rate(int flags, const char *buffer, size_t len) {
+  s21c_transformer t;
+  size_t consumed, left;
+  double best = 0, t0;
+
+  for (int run = 0; run < RUNS; run++) {
+    t0 = now();
+    s21c_init(&t, flags);
+    for (left = len; left; left -= consumed)
+      s21c_transform(&t, buffer + len - left, left, &consumed, out, sizeof(out));
+    s21c_finish(&t, out);
+    t0 = now() - t0;
+    if (len / t0 / 1e6 > best) best = len / t0 / 1e6;
+  }
+
+  return best;
+}
+
+// MB searched per second, or -1 when the count of selected lines differs
+// from the one of an earlier run.
+static double search_rate(const char *locale, const char *source, int flags,
+                          const char *buffer, size_t len, long *selected) {
+  s21g_patterns patterns;
+  s21g_search search;
+  char error[256], *sources[] = {(char *)source};
+  double best = 0, t0;
+  long count;
+
+  if (!setlocale(LC_ALL, locale) ||
+      s21g_compile(&patterns, sources, 1, flags, error, sizeof(error))) {
+    printf("%s: %s\n", source, error);
+    exit(1);
+  }
+  s21g_search_init(&search, &patterns, 0, NULL, NULL);
+  for (int run = 0; run < RUNS; run++) {
+    s21g_search_reset(&search, "corpus");
+    t0 = now();
+    count = s21g_search_buffer(&search, buffer, len);
+    t0 = now() - t0;
+    if (*selected >= 0 && count != *selected) best = -1;
+    *selected = count;
+    if (best >= 0 && len / t0 / 1e6 > best) best = len / t0 / 1e6;
+  }
+  s21g_free(&patterns);
+  setlocale(LC_ALL, "C");
+
+  return best;
+}
+
+static void bench_search(const char *name, const char *buffer, size_t len) {
+  static const struct {
+    const char *source;
+    int flags;
+  } searches[] = {{"ERROR.*failed", 0}, {"error", S21G_ICASE}, {"[0-9]+ ok", 0}};
+
+  for (size_t i = 0; i < sizeof(searches) / sizeof(searches[0]); i++) {
+    const char *source = searches[i].source;
+    int flags = searches[i].flags;
+    long selected = -1;
+    double c = search_rate("C", source, flags, buffer, len, &selected);
+    double multibyte = search_rate("C.UTF-8", source, flags, buffer, len, &selected);
+    double fast = search_rate("C.UTF-8", source, flags | S21G_UTF8, buffer, len, &selected);
+    if (c < 0 || multibyte < 0 || fast < 0) {
+      printf("%s %s: counts disagree\n", name, source);
+      exit(1);
+    }
+    printf("%-6s %-16s %10.0f %10.0f %10.0f %7.2fx\n", name, source, c,
+           multibyte, fast, fast / multibyte);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  size_t len = (size_t)(argc > 1 ? atoi(argv[1]) : 64) << 20, ascii_len, mixed_len;
+  char *ascii = malloc(len), *mixed = malloc(len), *printable = malloc(len);
+
+  if (!ascii || !mixed || !printable) return 1;
+  if (!setlocale(LC_ALL, "C.UTF-8")) {
+    printf("no C.UTF-8 locale\n");
+    return 1;
+  }
+  setlocale(LC_ALL, "C");
+  ascii_len = make_corpus(ascii, len, 0);
+  mixed_len = make_corpus(mixed, len, 1);
+  // the kernels scan all of a buffer without newlines or other controls
+  memset(printable, 'a', len);
+
+  printf("%zu MiB\n", len >> 20);
+  bench_kernels(printable, len);
+  for (int i = 0; i < 2; i++) {
+    const char *name = i ? "mixed" : "ascii", *buffer = i ? mixed : ascii;
+    size_t n = i ? mixed_len : ascii_len;
+    printf("cat %-6s -v %.0f MB/s, -v --utf8 %.0f MB/s\n", name,
+           cat_rate(S21C_NONPRINT, buffer, n),
+           cat_rate(S21C_NONPRINT | S21C_UTF8, buffer, n));
+  }
+  printf("%-6s %-16s %10s %10s %10s %8s\n", "corpus", "pattern", "C MB/s",
+         "mb MB/s", "fast MB/s", "fast/mb");
+  bench_search("ascii", ascii, ascii_len);
+  bench_search("mixed", mixed, mixed_len);
+
+  free(ascii);
+  free(mixed);
+  free(printable);
+
+  return 0;
+}
@@ -0,0 +1,40 @@
+# Benchmark corpora, sourced by bench.sh and train.sh.
+
+# corpus_patterns <count> <file>: -f patterns that share a literal prefix
+corpus_patterns() {
+	awk -v n="$1" 'BEGIN { for (i = 0; i < n; i++) printf "err_%d[0-9]+ms\n", i }' > "$2"
+}
+
+# corpus_small <count> <directory>: two-line log files
+corpus_small() {
+	mkdir -p "$2"
+	awk -v n="$1" -v dir="$2" 'BEGIN {
+		for (i = 0; i < n; i++) {
+			file = sprintf("%s/%06d", dir, i)
+			printf "request %d ok\nrequest %d err timeout\n", i, i > file
+			close(file)
+		}
+	}'
+}
+
+# corpus_noise <lines> <file>: 19 of 20 lines are DEBUG noise, 1 in 20 is
+# an ERROR
+corpus_noise() {
+	awk -v n="$1" 'BEGIN {
+		for (i = 0; i < n; i++)
+			if (i % 20) printf "%d DEBUG heartbeat ok seq=%d\n", i, i
+			else printf "%d ERROR request %d failed\n", i, i
+	}' > "$2"
+}
+
+# corpus_segments <count> <directory>: rotated log segments of 64 KiB each
+corpus_segments() {
+	mkdir -p "$2"
+	awk -v n="$1" -v dir="$2" 'BEGIN {
+		for (i = 0; i < n; i++) {
+			file = sprintf("%s/%06d", dir, i)
+			for (j = 0; j < 2048; j++) printf "%06d.%04d DEBUG heartbeat ok\n\n", i, j > file
+			close(file)
+		}
+	}'
+}
@@ -0,0 +1,34 @@
+#!/bin/bash
+# PGO training run (see make pgo): the instrumented binaries in $1 go
+# through the benchmark corpora with the common flags of both tools.
+
+. "$(dirname "$0")/corpus.sh"
+bin=$(cd "$1" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+corpus_patterns 2000 "$work/patterns"
+corpus_small 2000 "$work/small"
+corpus_noise 500000 "$work/noise"
+head -c 4194304 /dev/urandom > "$work/binary"
+
+# outputs go to a file, as in bench.sh
+train() { "$@" > "$work/out" 2>&1; }
+
+# every line costs a regexec per pattern, so -f gets a sample
+head -n 5000 "$work/noise" > "$work/sample"
+train "$bin/s21_grep" -c -f "$work/patterns" "$work/sample"
+for flags in "" -v -c -vc -n -i -w -x -l -o -on -h -b; do
+	train "$bin/s21_grep" $flags ERROR "$work/noise"
+done
+train "$bin/s21_grep" -o -e 'seq=[0-9]+' -e 'request [0-9]+' "$work/noise"
+train "$bin/s21_grep" -v -e DEBUG -e ok "$work/noise"
+(
+	cd "$work/small" || exit 1
+	for io in sync threads uring; do train "$bin/s21_grep" --io=$io -c timeout -- *; done
+)
+
+for flags in "" -n -b -s -e -t -v -E -T -nET -bs -vET; do
+	train "$bin/s21_cat" $flags "$work/noise" "$work/binary"
+done
+train "$bin/s21_cat" -n "$work"/small/*
@@ -0,0 +1,119 @@
+#!/bin/bash
+
+sample=$(mktemp)
+tail_file=$(mktemp)
+flags=(b e n s t v E T bn ns be st nv)
+fails=0
+# the binaries under test, e.g. build/asan (see make test PROFILE=...)
+bin=${BIN:-.}
+
+printf '\n\n\nfirst\tline\n\n\n\nsecond \001\177\200\211\212\237\240\377 line\n\t\n\nlast' > "$sample"
+printf ' continued\n\n\n\nend\n' > "$tail_file"
+
+make s21_cat > /dev/null
+
+run_test() {
+	cat "$@" > out1.txt
+	"$bin/s21_cat" "$@" > out2.txt
+	if diff -q out1.txt out2.txt > /dev/null; then
+		echo "$* SUCCESS"
+	else
+		echo "$* FAIL"
+		fails=$((fails + 1))
+	fi
+	rm -f out1.txt out2.txt
+}
+
+for flag in "${flags[@]}"; do
+	run_test -$flag "$sample" "$tail_file"
+done
+
+run_test "$sample" s21_cat.c
+run_test -n s21_cat.c s21_cat.h
+
+# --offset/--length print a byte range, numbered from its start
+range_test() {
+	tail -c +$(($1 + 1)) s21_cat.c | head -c "$2" | cat -n > out1.txt
+	"$bin/s21_cat" --offset="$1" --length="$2" -n s21_cat.c > out2.txt
+	if diff -q out1.txt out2.txt > /dev/null; then
+		echo "--offset=$1 --length=$2 SUCCESS"
+	else
+		echo "--offset=$1 --length=$2 FAIL"
+		fails=$((fails + 1))
+	fi
+	rm -f out1.txt out2.txt
+}
+range_test 0 100
+range_test 1000 2500
+range_test 100000 10
+
+# more files than are opened ahead: numbering and squeezing carry across
+many=$(mktemp -d)
+for i in $(seq 40); do printf 'file %d\n\n\n%s' $i "$([ $((i % 3)) = 0 ] && echo tail)" > "$many/$i"; done
+run_test -ns $(seq -f "$many/%g" 40)
+run_test -bE $(seq -f "$many/%g" 40)
+# with few descriptors files opened ahead are fewer, and one that can't be
+# is opened in its turn
+cat $(seq -f "$many/%g" 40) > out1.txt
+(ulimit -n 12; "$bin/s21_cat" --read-ahead=100 $(seq -f "$many/%g" 40); echo $?) > out2.txt
+echo 0 >> out1.txt
+if diff -q out1.txt out2.txt > /dev/null; then
+	echo "--read-ahead=100 under ulimit -n 12 SUCCESS"
+else
+	echo "--read-ahead=100 under ulimit -n 12 FAIL"
+	fails=$((fails + 1))
+fi
+rm -f out1.txt out2.txt
+rm -rf "$many"
+
+# a FIFO is opened in its turn: its writer may wait on the one before it
+fifos=$(mktemp -d)
+mkfifo "$fifos/1" "$fifos/2"
+{ head -c 200000 /dev/zero > "$fifos/1"; printf end > "$fifos/2"; } &
+timeout 10 "$bin/s21_cat" "$fifos/1" "$fifos/2" | wc -c > out2.txt
+echo 200003 > out1.txt
+if diff -q out1.txt out2.txt > /dev/null; then
+	echo "two FIFOs SUCCESS"
+else
+	echo "two FIFOs FAIL"
+	fails=$((fails + 1))
+	kill $! 2> /dev/null
+fi
+rm -f out1.txt out2.txt
+rm -rf "$fifos"
+
+# --utf8: -v leaves valid UTF-8 alone, also split between reads or files;
+# C1 controls, stray bytes and a character cut off at the end stay escaped
+utf8_test() {
+	printf "$1" > out1.txt
+	shift
+	"$bin/s21_cat" --utf8 "$@" > out2.txt
+	if diff -q out1.txt out2.txt > /dev/null; then
+		echo "--utf8 $* SUCCESS"
+	else
+		echo "--utf8 $* FAIL"
+		fails=$((fails + 1))
+	fi
+	rm -f out1.txt out2.txt
+}
+utf8=$(mktemp -d)
+printf 'caf\xc3\xa9 \xf0\x9f\x98\x80\t\xc2\x85 \x80 \xed\xa0\x80\n' > "$utf8/mixed"
+printf 'x\xc3' > "$utf8/head"
+printf '\xa9y\n' > "$utf8/tail"
+{ head -c 65535 /dev/zero | tr '\0' 'a'; printf '\xc3\xa9\xe2\x82\xac\n'; } > "$utf8/boundary"
+utf8_test 'caf\xc3\xa9 \xf0\x9f\x98\x80^IM-BM-^E M-^@ M-mM- M-^@\n' -vT "$utf8/mixed"
+utf8_test 'x\xc3\xa9y\n' -v "$utf8/head" "$utf8/tail"
+utf8_test 'xM-C' -v "$utf8/head"
+utf8_test "$(cat -n "$utf8/boundary")\n" -vn "$utf8/boundary"
+rm -rf "$utf8"
+
+# one 300 MB line without a newline is transformed as a stream
+huge=$(mktemp)
+{ printf '\t\001'; head -c 300000000 /dev/zero | tr '\0' 'a'; printf '\t\200'; } > "$huge"
+run_test -n "$huge"
+run_test -vET "$huge"
+rm -f "$huge"
+
+rm -f "$sample" "$tail_file"
+
+exit $((fails != 0))
@@ -0,0 +1,40 @@
+// libFuzzer entry point for the pattern compiler. The first byte picks the
+// pattern flags; the rest, up to a NUL, is split on newlines into
+// patterns, the way -f reads a pattern file. Invalid patterns must fail
+// cleanly, without leaks.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "s21_grep_lib.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  s21g_patterns patterns;
+  char error[256], *text, **sources;
+  int count = 1;
+
+  if (!size) return 0;
+  if (!(text = malloc(size))) return 0;
+  memcpy(text, data + 1, size - 1);
+  text[size - 1] = '\0';
+  for (char *p = text; *p; p++) count += *p == '\n';
+  if (!(sources = malloc(count * sizeof(char *)))) {
+    free(text);
+    return 0;
+  }
+  sources[0] = text;
+  for (int i = 1; i < count; i++) {
+    char *newline = strchr(sources[i - 1], '\n');
+    *newline = '\0';
+    sources[i] = newline + 1;
+  }
+
+  if (!s21g_compile(&patterns, sources, count, data[0] & 7, error, sizeof(error)))
+    s21g_free(&patterns);
+
+  free(sources);
+  free(text);
+
+  return 0;
+}
@@ -0,0 +1,64 @@
+// Standalone driver for the libFuzzer entry points, for compilers without
+// -fsanitize=fuzzer: replays the files given as arguments (crash inputs
+// or a corpus), or with none runs random inputs built from regex syntax
+// and a small alphabet, so patterns are valid and match often.
+//   usage: fuzz_<target> [file...]
+//   FUZZ_RUNS=<inputs> FUZZ_SEED=<seed> fuzz_<target>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static int replay(const char *filename) {
+  FILE *file = fopen(filename, "rb");
+  uint8_t *data = NULL;
+  long size = -1;
+
+  if (file && !fseek(file, 0, SEEK_END) && (size = ftell(file)) >= 0 &&
+      !fseek(file, 0, SEEK_SET) && (data = malloc(size ? size : 1)) &&
+      fread(data, 1, size, file) == (size_t)size) {
+    LLVMFuzzerTestOneInput(data, size);
+  } else {
+    fprintf(stderr, "%s: cannot read\n", filename);
+    size = -1;
+  }
+  free(data);
+  if (file) fclose(file);
+
+  return size < 0;
+}
+
+static size_t random_input(uint8_t *data, size_t cap) {
+  static const char syntax[] = "ab.*+?|()[]^$ \n";
+  static const char alphabet[] = "aaabbx_ .\t\n";
+  size_t size = 0, patterns = rand() % 40, input = rand() % 2000;
+
+  data[size++] = rand();
+  for (size_t i = 0; i < patterns && size < cap; i++)
+    data[size++] = rand() % 3 ? alphabet[rand() % 9] : syntax[rand() % 15];
+  if (size < cap) data[size++] = '\0';
+  for (size_t i = 0; i < input && size < cap; i++)
+    data[size++] = rand() % 200 ? alphabet[rand() % 11] : rand();
+
+  return size;
+}
+
+int main(int argc, char *argv[]) {
+  const char *runs = getenv("FUZZ_RUNS"), *seed = getenv("FUZZ_SEED");
+  static uint8_t data[4096];
+  unsigned start = seed ? (unsigned)atoi(seed) : (unsigned)time(NULL);
+  int failed = 0;
+
+  for (int i = 1; i < argc; i++) failed |= replay(argv[i]);
+  if (argc > 1) return failed;
+
+  fprintf(stderr, "seed %u\n", start);
+  srand(start);
+  for (long i = 0, n = runs ? atol(runs) : 10000; i < n; i++)
+    LLVMFuzzerTestOneInput(data, random_input(data, sizeof(data)));
+
+  return 0;
+}
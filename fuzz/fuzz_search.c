@@ -0,0 +1,105 @@
+// libFuzzer entry point for the line matcher. The first byte picks the
+// pattern flags, the search mode and a chunk size; patterns follow, one per
+// line, up to the first NUL, and the rest is the input. The input is
+// searched whole and again fed to a stream in chunks: both must report the
+// same lines and spans, and every span must lie inside its line.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "s21_grep_lib.h"
+
+typedef struct {
+  const char *input;  // set when lines must point into it
+  unsigned long long hash;
+  long long last_offset;
+} record;
+
+static void mix(record *r, unsigned long long value) {
+  r->hash = (r->hash ^ value) * 0x100000001b3ULL;
+}
+
+static int check_match(const s21g_match *match, void *data) {
+  record *r = data;
+
+  if (match->so > match->eo || match->eo > match->line_len) abort();
+  if (match->offset < r->last_offset) abort();
+  if (r->input && match->line != r->input + match->offset) abort();
+  r->last_offset = match->offset;
+
+  mix(r, match->line_number);
+  mix(r, match->offset);
+  mix(r, match->so);
+  mix(r, match->eo);
+  mix(r, match->pattern);
+  mix(r, match->continued * 2 + match->more);
+  for (size_t i = 0; i < match->line_len; i++) mix(r, (unsigned char)match->line[i]);
+
+  return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  static const size_t chunks[] = {1, 7, 64, 4096};
+  s21g_patterns patterns;
+  s21g_search search;
+  s21g_stream stream;
+  record whole = {0}, fed = {0};
+  const char *nul;
+  char *text, **sources, *input;
+  size_t input_len;
+  long selected;
+  int count = 1;
+
+  if (size < 2 || !(nul = memchr(data + 1, '\0', size - 1))) return 0;
+  // lines stay under the stream's max_line, so neither side windows them
+  input_len = size - (nul + 1 - (const char *)data);
+  if (input_len > S21G_BLOCK_SIZE) return 0;
+
+  if (!(text = strdup((const char *)data + 1))) return 0;
+  for (char *p = text; *p; p++) count += *p == '\n';
+  if (!(sources = malloc(count * sizeof(char *)))) {
+    free(text);
+    return 0;
+  }
+  sources[0] = text;
+  for (int i = 1; i < count; i++) {
+    char *newline = strchr(sources[i - 1], '\n');
+    *newline = '\0';
+    sources[i] = newline + 1;
+  }
+
+  // the input gets a NUL after it, like the buffers of s21_grep
+  if ((input = malloc(input_len + 1)) &&
+      !s21g_compile(&patterns, sources, count, data[0] & 7, NULL, 0)) {
+    // spans of inverted lines depend on the chunks, so S21G_SPANS is left out
+    int mode = (data[0] >> 3) & 7;
+    size_t chunk = chunks[data[0] >> 6];
+
+    memcpy(input, nul + 1, input_len);
+    input[input_len] = '\0';
+    whole.input = input;
+    whole.last_offset = fed.last_offset = -1;
+    s21g_search_init(&search, &patterns, mode, check_match, &whole);
+    selected = s21g_search_buffer(&search, input, input_len);
+
+    s21g_search_init(&search, &patterns, mode, check_match, &fed);
+    s21g_stream_init(&stream);
+    for (size_t at = 0; at < input_len; at += chunk)
+      s21g_stream_feed(&search, &stream, input + at,
+                       input_len - at < chunk ? input_len - at : chunk);
+    s21g_stream_finish(&search, &stream);
+    s21g_stream_free(&stream);
+
+    if (selected != search.selected || whole.hash != fed.hash) abort();
+    s21g_free(&patterns);
+  }
+
+  free(input);
+  free(sources);
+  free(text);
+
+  return 0;
+}
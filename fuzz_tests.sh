@@ -0,0 +1,137 @@
+#!/bin/bash
+# Differential fuzzing against GNU grep and cat: random inputs (long lines,
+# binary bytes, empty lines) and random pattern sets (empty patterns, many
+# -e, large -f files) under random flags. Output bytes and exit codes must
+# match. Failing cases are kept in fuzz_failures/ with the command line.
+#   FUZZ_RUNS=<cases per tool> FUZZ_SEED=<seed> bash fuzz_tests.sh
+
+export LC_ALL=C
+root=$PWD
+runs=${FUZZ_RUNS:-300}
+seed=${FUZZ_SEED:-$RANDOM}
+work=$(mktemp -d)
+fails=0
+trap 'rm -rf "$work"' EXIT
+
+make s21_grep s21_cat > /dev/null
+
+# random_file <seed> <path>: lines of mixed lengths from a small alphabet,
+# so random patterns match often, with some control and high bytes. No NUL:
+# regcomp never lets . match one, where GNU grep's own matcher does.
+random_file() {
+	awk -v seed="$1" '
+	function random_byte(r, c) {
+		r = rand()
+		if (r < 0.97) return substr(alphabet, 1 + int(rand() * length(alphabet)), 1)
+		c = 1 + int(rand() * 254)
+		return sprintf("%c", c >= 10 ? c + 1 : c)
+	}
+	BEGIN {
+		srand(seed)
+		alphabet = "aaabbx_ .\t"
+		# long lines repeat one random block, a prime length long
+		for (j = 0; j < 997; j++) block = block random_byte()
+		lines = int(rand() * 60)
+		for (i = 0; i < lines; i++) {
+			r = rand()
+			if (r < 0.97) {
+				len = r < 0.7 ? int(rand() * 40) : int(rand() * 400)
+				for (j = 0; j < len; j++) printf "%s", random_byte()
+			} else {
+				for (len = 5000 + int(rand() * 300000); len > 997; len -= 997) printf "%s", block
+				printf "%s", substr(block, 1, len)
+			}
+			# the last line sometimes has no newline
+			if (i < lines - 1 || rand() < 0.8) printf "\n"
+		}
+	}' > "$2"
+}
+
+# random_patterns <seed> <count>: well-formed EREs, one per line
+random_patterns() {
+	awk -v seed="$1" -v count="$2" 'BEGIN {
+		srand(seed)
+		split("a b x _ ab ba . [ab] [^a] a* b+ x? (a|b) a{2} [[:space:]] (ab)*", atoms, " ")
+		for (i = 0; i < count; i++) {
+			pattern = rand() < 0.1 ? "^" : ""
+			n = rand() < 0.05 ? 0 : 1 + int(rand() * 4)
+			for (j = 0; j < n; j++) pattern = pattern atoms[1 + int(rand() * 16)]
+			if (rand() < 0.1) pattern = pattern "$"
+			print pattern
+		}
+	}'
+}
+
+# compare <name> <arguments...>: runs ${gnu[@]} and ${ours[@]} on them
+compare() {
+	local name=$1 expected actual
+	shift
+	(cd "$work" && "${gnu[@]}" "$@" > gnu.out 2> /dev/null)
+	expected=$?
+	(cd "$work" && "${ours[@]}" "$@" > ours.out 2> /dev/null)
+	actual=$?
+	if ! cmp -s "$work/gnu.out" "$work/ours.out" || [ $expected != $actual ]; then
+		fails=$((fails + 1))
+		local keep="fuzz_failures/$name"
+		mkdir -p "$keep"
+		cp "$work"/* "$keep"/ 2> /dev/null
+		{
+			printf '%q ' "${ours[@]}" "$@"
+			printf '\n# exit %d, ours %d\n' $expected $actual
+		} > "$keep/cmd"
+		echo "$name FAIL: $*"
+	fi
+}
+
+echo "seed $seed, $runs cases per tool"
+grep_flags=(i v c l n h o w x b Z)
+gnu=(grep -E -a)
+ours=("$root/s21_grep")
+for ((run = 0; run < runs; run++)); do
+	case_seed=$((seed * 1000 + run))
+	RANDOM=$case_seed
+	rm -f "$work"/*
+	files=()
+	count=$((1 + RANDOM % 5))
+	for ((f = 0; f < count; f++)); do
+		random_file $((case_seed * 10 + f)) "$work/in$f"
+		files+=("in$f")
+	done
+	args=()
+	for flag in "${grep_flags[@]}"; do
+		if ((RANDOM % 4 == 0)); then args+=(-$flag); fi
+	done
+	# -s hides the missing file message, which goes to different streams
+	if ((RANDOM % 10 == 0)); then args+=(-s); files+=(missing); fi
+	count=$((RANDOM % 10 == 0 ? 200 + RANDOM % 300 : 1 + RANDOM % 3))
+	random_patterns $case_seed $count > "$work/patterns"
+	if ((count > 3)); then
+		args+=(-f patterns)
+	else
+		while IFS= read -r pattern; do args+=(-e "$pattern"); done < "$work/patterns"
+	fi
+	compare "grep-$case_seed" "${args[@]}" "${files[@]}"
+done
+
+cat_flags=(b e n s t v E T)
+gnu=(cat)
+ours=("$root/s21_cat")
+for ((run = 0; run < runs; run++)); do
+	case_seed=$((seed * 1000 + run))
+	RANDOM=$case_seed
+	rm -f "$work"/*
+	files=()
+	count=$((1 + RANDOM % 3))
+	for ((f = 0; f < count; f++)); do
+		random_file $((case_seed * 10 + f)) "$work/in$f"
+		files+=("in$f")
+	done
+	args=()
+	for flag in "${cat_flags[@]}"; do
+		if ((RANDOM % 3 == 0)); then args+=(-$flag); fi
+	done
+	compare "cat-$case_seed" "${args[@]}" "${files[@]}"
+done
+
+echo "$fails failures"
+exit $((fails != 0))
@@ -0,0 +1,270 @@
+#!/bin/bash
+
+files="s21_grep.c s21_grep.h"
+pattern="options"
+flags=(e i v c n o l h w x wo wn xc b bo bn)
+fails=0
+# the binaries under test, e.g. build/asan (see make test PROFILE=...)
+bin=${BIN:-.}
+
+make s21_grep > /dev/null
+
+check() {
+	if diff -q out1.txt out2.txt > /dev/null; then
+		echo "$1 SUCCESS"
+	else
+		echo "$1 FAIL"
+		fails=$((fails + 1))
+	fi
+	rm -f out1.txt out2.txt
+}
+
+run_test() {
+	grep "$@" > out1.txt
+	"$bin/s21_grep" "$@" > out2.txt
+	check "$*"
+}
+
+for flag in "${flags[@]}"; do
+	run_test -$flag $pattern $files
+done
+
+run_test -x "} flags;" $files
+run_test -w -e int -e char $files
+run_test -s $pattern invalid.txt
+run_test -Z $pattern $files
+run_test -Zc $pattern $files
+run_test -Zl $pattern $files
+# -v on one file writes runs of lines whole; -w/-x lines are still verified
+run_test -v $pattern s21_grep.c
+run_test -v -w -e int -e flags s21_grep.c
+run_test -v -x "" s21_grep.c
+# -f from a pipe or process substitution, which have no size to map
+printf 'options\nint' | grep -c -f /dev/stdin $files > out1.txt
+printf 'options\nint' | "$bin/s21_grep" -c -f /dev/stdin $files > out2.txt
+check "-c -f /dev/stdin"
+grep -n -f <(printf 'options\nint\n') $files > out1.txt
+"$bin/s21_grep" -n -f <(printf 'options\nint\n') $files > out2.txt
+check "-n -f <(...)"
+# many files go through the read-ahead, which must read pipes to the end
+# and report a directory like a single file does
+for io in sync threads uring; do
+	{ grep -c 1 $files . <(seq 100000) s21_grep.c; echo $?; } 2> /dev/null > out1.txt
+	{ "$bin/s21_grep" --io=$io -c 1 $files . <(seq 100000) s21_grep.c; echo $?; } 2> /dev/null | grep -v '^grep:' > out2.txt
+	check "--io=$io -c with a pipe and a directory"
+done
+# under a low descriptor limit the window shrinks and nothing is skipped
+many=$(mktemp -d)
+for i in $(seq 40); do echo "line $i" > "$many/$i"; done
+for io in threads uring auto; do
+	{ grep -c line "$many"/*; echo $?; } > out1.txt
+	(ulimit -n 24; "$bin/s21_grep" --io=$io -c line "$many"/*; echo $?) > out2.txt
+	check "--io=$io -c over 40 files under ulimit -n 24"
+done
+rm -rf "$many"
+# a match failing -w at its end gives way to a shorter one at its start
+words=$(mktemp)
+printf 'foo barx\naa.bx.babxb\nfoo bar\n' > "$words"
+grep -E -nwo 'foo|foo bar' "$words" > out1.txt
+"$bin/s21_grep" -nwo 'foo|foo bar' "$words" > out2.txt
+check "-nwo foo|foo bar"
+run_test -cw 'bx*[^a]' "$words"
+rm -f "$words"
+
+# --count-by-pattern: what grep -c (with -o, grep -o | wc -l) says per pattern
+by_pattern=(-e options -e int -e "^}" -e nothing)
+for flag in "" o v w; do
+	for file in $files; do
+		for ((i = 1; i < ${#by_pattern[@]}; i += 2)); do
+			p=${by_pattern[i]}
+			if [ "$flag" = o ]; then
+				count=$(grep -o -e "$p" "$file" | wc -l)
+			else
+				count=$(grep -c ${flag:+-$flag} -e "$p" "$file")
+			fi
+			printf '%s:%d:%s\n' "$file" "$count" "$p"
+		done
+	done > out1.txt
+	"$bin/s21_grep" --count-by-pattern ${flag:+-$flag} "${by_pattern[@]}" $files > out2.txt
+	check "--count-by-pattern ${flag:+-$flag}"
+done
+
+# a UTF-8 locale: characters, not bytes, on lines in and between long
+# ASCII runs, which are searched with the single-byte compile
+if locale -a 2> /dev/null | grep -qix 'c.utf-\?8'; then
+	utf8=$(mktemp)
+	for i in $(seq 1000); do
+		printf 'line %d options ok\n' $i
+		if ((i % 300 == 0)); then printf 'caf\xc3\xa9 \xc3\x89t\xc3\xa9 na\xc3\xafve \xe6\x97\xa5\n'; fi
+	done > "$utf8"
+	for args in "-i é" "-o caf." "-c ^caf..É" "-w na.ve" "-x caf.*日" "-n é.*[[:alpha:]]" "-ow \w\w*"; do
+		LC_ALL=C.UTF-8 run_test $args "$utf8"
+	done
+	rm -f "$utf8"
+fi
+
+# -P exists only in builds with PCRE2
+if "$bin/s21_grep" -P x /dev/null 2> /dev/null; [ $? != 2 ]; then
+	for flag in "" o w x i n v c wo; do
+		run_test -P ${flag:+-$flag} 'opt\w+s' $files
+	done
+	run_test -P -o 'is\K\w+' $files
+	# GNU grep -P takes a single pattern; ours takes all -e as one set
+	grep -P -n 'opt\w+s|\bint(?= )' $files > out1.txt
+	"$bin/s21_grep" -P -n -e 'opt\w+s' -e '\bint(?= )' $files > out2.txt
+	check "-P -n -e opt\w+s -e \bint(?= )"
+	# the subject is one line: \A and \z are its ends
+	run_test -P -c '\Aint' $files
+	run_test -P -n ';\z' $files
+	run_test -P -c '(?<!\n)#' $files
+	# a backtracking limit is an error, not a line without a match
+	backtrack=$(mktemp)
+	printf 'aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab\n' > "$backtrack"
+	grep -P -c '(a+)+$' "$backtrack" > /dev/null 2>&1; echo $? > out1.txt
+	"$bin/s21_grep" -P -c '(a+)+$' "$backtrack" > /dev/null 2>&1; echo $? > out2.txt
+	check "-P match limit exit status"
+	rm -f "$backtrack"
+fi
+
+# one 300 MB line without a newline, searched in bounded windows
+huge=$(mktemp)
+{ printf 'options first '; head -c 300000000 /dev/zero | tr '\0' 'a'; printf ' options last'; } > "$huge"
+run_test -c options "$huge"
+run_test -o options "$huge"
+run_test -b -o options "$huge"
+run_test -c -v options "$huge"
+run_test options "$huge"
+printf '2:options\n1:last\n' > out1.txt
+"$bin/s21_grep" --count-by-pattern -o -e options -e last "$huge" > out2.txt
+check "--count-by-pattern -o on a long line"
+# the smallest --memory budget only shrinks the windows
+grep -o options "$huge" > out1.txt
+"$bin/s21_grep" --memory=256K -o options "$huge" > out2.txt
+check "--memory=256K -o options"
+# anchored patterns whose matches fit in a window are searched window by
+# window, so the line is never held whole
+grep -c 'options last$' "$huge" > out1.txt
+echo "under 100 MiB" >> out1.txt
+"$bin/s21_grep" --memory=1M --stats -c 'options last$' "$huge" 2> stats.txt > out2.txt
+rss=$(sed -n 's/^peak RSS: \([0-9]*\) KiB$/\1/p' stats.txt)
+[ "${rss:-0}" -gt 0 ] && [ "$rss" -lt 102400 ] && echo "under 100 MiB" >> out2.txt
+rm -f stats.txt
+check "--memory=1M -c 'options last\$' in bounded memory"
+rm -f "$huge"
+
+# --memory is charged what the compiled patterns keep, far more than their
+# 16 KB of sources
+templates=$(mktemp)
+seq 1000 | sed 's/^/word[a-z]+x/' > "$templates"
+grep -E -c -f "$templates" $files > out1.txt
+echo "over 1 MB of patterns" >> out1.txt
+"$bin/s21_grep" --stats -c -f "$templates" $files 2> stats.txt > out2.txt
+charged=$(sed -n 's/^patterns: \([0-9]*\) bytes$/\1/p' stats.txt)
+[ "${charged:-0}" -gt 1048576 ] && echo "over 1 MB of patterns" >> out2.txt
+rm -f stats.txt "$templates"
+check "--stats charges the compiled patterns"
+
+# anchored sets and -x search a long line whole, against its real ends
+long=$(mktemp)
+{ head -c 2000000 /dev/zero | tr '\0' x; printf 'START\nshort\n'; head -c 1500000 /dev/zero | tr '\0' z; echo; } > "$long"
+run_test -c '^x*START' "$long"
+run_test -n 'z$' "$long"
+run_test -cx 'z*' "$long"
+run_test -nx short "$long"
+grep -E -bo '^short|START$' "$long" > out1.txt
+"$bin/s21_grep" -bo '^short|START$' "$long" > out2.txt
+check "-bo ^short|START$"
+grep -c 'zz*$' "$long" > out1.txt
+timeout 10 "$bin/s21_grep" --memory=256K -c 'zz*$' "$long" > out2.txt
+check "--memory=256K -c zz*$"
+# long lines selected from a pipe are printed whole
+cat "$long" | grep -v short > out1.txt
+cat "$long" | "$bin/s21_grep" -v short /dev/stdin > out2.txt
+check "-v short from a pipe"
+cat "$long" | grep -n S > out1.txt
+cat "$long" | "$bin/s21_grep" --memory=256K -n S /dev/stdin > out2.txt
+check "--memory=256K -n S from a pipe"
+rm -f "$long"
+# a window after the first keeps the byte before it for -w, \< and \b
+edge=$(mktemp)
+{ head -c 1044480 /dev/zero | tr '\0' x; printf 'foo '; head -c 3000000 /dev/zero | tr '\0' y; echo; } > "$edge"
+run_test -cw foo "$edge"
+run_test -c '\<foo' "$edge"
+run_test -c 'foo\>' "$edge"
+rm -f "$edge"
+
+# --json: one object per line, spans in bytes, strings escaped
+json=$(mktemp)
+printf 'other\nfoo "x"\tfoo\n' > "$json"
+printf '{"file":"%s","line":2,"offset":6,"text":"foo \\"x\\"\\tfoo","matches":[[0,3],[8,11]]}\n' "$json" > out1.txt
+"$bin/s21_grep" --json foo "$json" > out2.txt
+check "--json"
+# bytes that aren't UTF-8 stand as U+FFFD, with the exact line in base64
+printf 'foo \377\n' > "$json"
+printf '{"file":"%s","line":1,"offset":0,"text":"foo \\ufffd","text_bytes":"Zm9vIP8=","matches":[[0,3]]}\n' "$json" > out1.txt
+"$bin/s21_grep" --json foo "$json" > out2.txt
+check "--json with a byte that isn't UTF-8"
+# a line over max_line is only given in base64, joined across its fragments
+{ head -c 700000 /dev/zero | tr '\0' x; printf ' foo \377\n'; } > "$json"
+head -n 1 "$json" > out1.txt
+"$bin/s21_grep" --memory=256K --json foo "$json" | sed 's/.*"text_bytes":"\([^"]*\)".*/\1/' | base64 -d > out2.txt; echo >> out2.txt
+check "--json on a line over max_line"
+rm -f "$json"
+
+# --follow: lines appended after the first pass are reported too
+log=$(mktemp)
+printf 'options one\n' > "$log"
+"$bin/s21_grep" --follow -n options "$log" > out2.txt &
+follower=$!
+sleep 0.2
+printf 'other\noptions two\n' >> "$log"
+sleep 0.2
+kill $follower
+printf '1:options one\n3:options two\n' > out1.txt
+check "--follow"
+rm -f "$log"
+
+# --daemon: a search sent with --server prints and exits as a local one,
+# from the client's directory, again once its patterns and files are cached
+socket=$(mktemp -u)
+"$bin/s21_grep" --daemon="$socket" --memory=1M &
+daemon=$!
+for _ in $(seq 50); do [ -S "$socket" ] && break; sleep 0.1; done
+served_test() {
+	grep "$@" > out1.txt
+	echo "exit $?" >> out1.txt
+	"$bin/s21_grep" --server="$socket" "$@" > out2.txt
+	echo "exit $?" >> out2.txt
+	check "--server $*"
+}
+for flag in c n o l v; do
+	served_test -$flag $pattern $files
+done
+served_test -n $pattern $files
+served_test -w -e int -e char $files
+served_test -s $pattern invalid.txt
+served_test -c nothing_matches_this $files
+# -f files are read by the worker; a file over the daemon's --memory isn't copied
+templates=$(mktemp)
+printf 'options\nchar\n' > "$templates"
+served_test -n -e int -f "$templates" $files
+big=$(mktemp)
+seq 300000 > "$big"
+served_test -c 99 "$big" $files
+served_test -c 99 "$big" $files
+rm -f "$templates" "$big"
+# clients side by side
+grep -n $pattern $files > out1.txt
+for i in $(seq 16); do
+	"$bin/s21_grep" --server="$socket" -n $pattern $files > "out2.$i.txt" &
+done
+wait $(jobs -p | grep -v "^$daemon\$")
+for i in $(seq 16); do cmp -s out1.txt "out2.$i.txt" || break; done
+mv "out2.$i.txt" out2.txt
+rm -f out2.*.txt
+check "--server, 16 clients at once"
+kill $daemon
+wait $daemon 2> /dev/null
+rm -f "$socket"
+
+exit $((fails != 0))
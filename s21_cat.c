@@ -4,14 +4,21 @@ struct option long_options[] = {
     {"number-nonblank", no_argument, 0, 'b'},
     {"number", no_argument, 0, 'n'},
     {"squeeze-blank", no_argument, 0, 's'},
+    {"memory", required_argument, 0, OPT_MEMORY},
+    {"stats", no_argument, 0, OPT_STATS},
+    {"offset", required_argument, 0, OPT_OFFSET},
+    {"length", required_argument, 0, OPT_LENGTH},
+    {"read-ahead", required_argument, 0, OPT_READ_AHEAD},
+    {"utf8", no_argument, 0, OPT_UTF8},
     {0, 0, 0, 0}};
 
+cat_stats stats;
 
 int main(int argc, char *argv[]) {
-  char get_opt;
-  int error = 0, op_index = 0;
-  int count_lines = 0;
-  flags options = {0, 0, 0, 0, 0, 0};
+  int get_opt, error = 0, failed = 0, op_index = 0, *fds = NULL;
+  flags options = {.read_ahead = S21C_READ_AHEAD};
+  s21c_transformer transformer;
+  char *end, tail[S21C_MAX_EXPANSION];
 
   while (!error && (get_opt = getopt_long(argc, argv, ":benstvET", long_options,
                                           &op_index)) != -1) {
@@ -43,6 +50,26 @@ int main(int argc, char *argv[]) {
         case 'T':
           options.T = 1;
           break;
+        case OPT_MEMORY:
+          error = !(options.memory = s21_parse_memory(optarg));
+          break;
+        case OPT_STATS:
+          options.stats = 1;
+          break;
+        case OPT_OFFSET:
+          error = !s21_parse_size(optarg, &options.offset);
+          break;
+        case OPT_LENGTH:
+          error = !s21_parse_size(optarg, &options.length);
+          options.limited = 1;
+          break;
+        case OPT_UTF8:
+          options.utf8 = 1;
+          break;
+        case OPT_READ_AHEAD:
+          options.read_ahead = strtol(optarg, &end, 10);
+          error = *end || end == optarg || options.read_ahead < 0;
+          break;
         default:
           error = 1;
           break;
@@ -50,65 +77,134 @@ int main(int argc, char *argv[]) {
     }
 
   if (!error) {
-    while (optind < argc) {
-      if (print_file(argv[optind], options, &count_lines))
-        printf("%s: No such file or directory\n", argv[optind]);
-      optind++;
+    // one transformer for all files keeps numbering going across them
+    s21c_init(&transformer, transform_flags(options));
+    // fds[i] is -2 until argv[optind + i] is opened, ahead of its turn, or
+    // left to be opened in its turn (-3): no regular file, or no descriptor
+    options.read_ahead = read_ahead_limit(options.read_ahead);
+    fds = malloc((argc - optind + 1) * sizeof(int));
+    if (!fds) options.read_ahead = 0;
+    for (int i = 0; fds && i < argc - optind; i++) fds[i] = -2;
+    for (int i = 0; optind + i < argc; i++) {
+      for (int j = i; fds && j <= i + options.read_ahead && optind + j < argc; j++)
+        if (fds[j] == -2 || (j == i && fds[j] == -3))
+          fds[j] = j == i ? open_file(argv[optind + j], &options)
+                          : open_ahead(argv[optind + j], &options);
+      if (print_file(fds ? fds[i] : open_file(argv[optind + i], &options),
+                     &transformer, &options)) {
+        printf("%s: No such file or directory\n", argv[optind + i]);
+        failed = 1;
+      }
     }
+    free(fds);
+    // a character cut off at the very end is written escaped
+    fwrite(tail, 1, s21c_finish(&transformer, tail), stdout);
+    if (options.stats) print_stats(options);
   } else {
     printf("Error command line arguments!\n");
   }
 
-  return 0;
+  // like GNU cat: 1 when an option or a file failed
+  return error || failed;
 }
 
-int print_file(char *filename, flags options, int *count_lines) {
-  char ch = '\0';
-  int result;
-  int nlc = 1;  // new lines count
-  FILE *f = fopen(filename, "r");
-
-  !f ? (result = 0) : (result = 1);
-  
-  while (result && (ch = fgetc(f)) != EOF) {
-      if (ch == '\n' && options.s && nlc > 1) {
-        ch = fgetc(f);
-        // if(ch != '\n') {
-        //   printf("%c", ch);
-        // } РАБОТАЕТ НО ЛОМАЕТ В ДРУГИХ МЕСТАХ XD );
-        continue;
-      }
+int transform_flags(flags options) {
+  return (options.b ? S21C_NUMBER_NONBLANK : 0) |
+         (options.n ? S21C_NUMBER : 0) | (options.s ? S21C_SQUEEZE : 0) |
+         (options.v ? S21C_NONPRINT : 0) | (options.E ? S21C_ENDS : 0) |
+         (options.T ? S21C_TABS : 0) | (options.utf8 ? S21C_UTF8 : 0);
+}
 
-      if (nlc && (options.n || (ch != '\n' && options.b)))
-        printf("%6d\t", ++(*count_lines));
+// The two block buffers are all s21_cat allocates, well inside the
+// smallest budget --memory accepts.
+void print_stats(flags options) {
+  fflush(stdout);
+  if (options.memory)
+    fprintf(stderr, "memory budget: %zu bytes\n", options.memory);
+  else
+    fprintf(stderr, "memory budget: none\n");
+  fprintf(stderr, "buffers: %d bytes, largest read %zu bytes\n",
+          2 * S21C_BLOCK_SIZE, stats.read_peak);
+  fprintf(stderr, "peak RSS: %ld KiB\n", s21_peak_rss());
+}
 
-      if (options.E && ch == '\n') printf("$");
+// Drops the first len bytes of an input that can't seek.
+static void skip_bytes(int fd, char *buffer, size_t size, unsigned long long len) {
+  ssize_t n;
 
-      if (options.T && ch == '\t')
-        printf("^I");
-      else {
-        ch == '\n' ? nlc++ : (nlc = 0);
-        options.v ? non_print(ch) : printf("%c", ch);
-      }
-    }
+  while (len && (n = read(fd, buffer, len < size ? len : size)) > 0) len -= n;
+}
 
+// Opens a file and asks the kernel to start reading the bytes that will be
+// printed first, so that a file opened ahead of its turn is in the page
+// cache by the time print_file reaches it instead of stalling every file
+// boundary on the disk. The read-ahead window then grows as it is read.
+int open_file(const char *filename, const flags *options) {
+  int fd = open(filename, O_RDONLY);
+  unsigned long long len = S21C_PREFETCH;
 
-  if (result) fclose(f);
+  if (options->limited && options->length < len) len = options->length;
+  if (fd >= 0 && options->read_ahead) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, options->offset, len, POSIX_FADV_WILLNEED);
+  }
 
-  return !result;
+  return fd;
 }
 
-  void non_print(char c) {
-    if (c < -96)
-      printf("M-^%c", c + 192);
-    else if (c < 0)
-      printf("M-%c", c + 128);
-    else if (c == 9 || c == 10)
-      printf("%c", c);
-    else if (c < 32)
-      printf("^%c", c + 64);
-    else if (c < 127)
-      printf("%c", c);
-    else
-      printf("^?");
-  }
\ No newline at end of file
+// Opens a file ahead of its turn if it is a regular file, else returns -3:
+// opening a FIFO blocks until it has a writer, which may be waiting for the
+// files before it to be read. A file that fails to open early (out of
+// descriptors, say) gets -3 too and is tried again in its turn.
+int open_ahead(const char *filename, const flags *options) {
+  struct stat st;
+  int fd = -3;
+
+  if (!stat(filename, &st) && S_ISREG(st.st_mode)) fd = open_file(filename, options);
+
+  return fd < 0 ? -3 : fd;
+}
+
+// Files opened ahead hold a descriptor each on top of stdin, stdout,
+// stderr and the file being printed.
+int read_ahead_limit(int read_ahead) {
+  struct rlimit limit;
+
+  if (!getrlimit(RLIMIT_NOFILE, &limit) && limit.rlim_cur != RLIM_INFINITY &&
+      (rlim_t)read_ahead + 4 > limit.rlim_cur)
+    read_ahead = limit.rlim_cur > 4 ? limit.rlim_cur - 4 : 0;
+
+  return read_ahead;
+}
+
+// --offset seeks past the bytes before the range instead of reading them
+// and --length stops reading at its end, so a range of a large file costs
+// only the range. Line numbers count from the start of the range.
+int print_file(int fd, s21c_transformer *transformer, const flags *options) {
+  static char in[S21C_BLOCK_SIZE], out[S21C_BLOCK_SIZE];
+  int result;
+  ssize_t n = 0;
+  unsigned long long left = options->length;
+
+  fd < 0 ? (result = 0) : (result = 1);
+
+  if (result && options->offset &&
+      lseek(fd, options->offset, SEEK_SET) != (off_t)options->offset)
+    skip_bytes(fd, in, sizeof(in), options->offset);
+  while (result && (!options->limited || left) &&
+         (n = read(fd, in, options->limited && left < sizeof(in) ? left : sizeof(in))) > 0) {
+    size_t done = 0, consumed;
+    left -= n;
+    if ((size_t)n > stats.read_peak) stats.read_peak = n;
+    while (done < (size_t)n) {
+      size_t written = s21c_transform(transformer, in + done, n - done,
+                                      &consumed, out, sizeof(out));
+      fwrite(out, 1, written, stdout);
+      done += consumed;
+    }
+  }
+
+  if (result) close(fd);
+
+  return !result;
+}
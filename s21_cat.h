@@ -1,11 +1,32 @@
 #ifndef S21_CAT_H
 #define S21_CAT_H
 
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include "s21_cat_lib.h"
+#include "s21_memory.h"
+
+// long-only options
+#define OPT_MEMORY 256
+#define OPT_STATS 257
+#define OPT_OFFSET 258
+#define OPT_LENGTH 259
+#define OPT_READ_AHEAD 260
+#define OPT_UTF8 261
+
+// files opened and prefetched ahead of the one being printed, and how much
+// of each the kernel is asked to read in
+#define S21C_READ_AHEAD 16
+#define S21C_PREFETCH (1 << 20)
+
 typedef struct {
   int b;
   int n;
@@ -13,11 +34,28 @@ typedef struct {
   int v;
   int E;
   int T;
+  size_t memory;  // --memory budget, 0 for none
+  int stats;
+  unsigned long long offset;  // --offset/--length: the byte range to print
+  unsigned long long length;
+  int limited;  // --length was given
+  int read_ahead;  // --read-ahead: files to open ahead, 0 for none
+  int utf8;  // --utf8: -v leaves valid UTF-8 alone
 } flags;
 
+// --stats: what the buffers reached, printed on stderr at exit
+typedef struct {
+  size_t read_peak;
+} cat_stats;
+
 extern struct option long_options[];
+extern cat_stats stats;
 
-int print_file(char *filename, flags options, int *count_lines);
-void non_print(char c);
+int open_file(const char *filename, const flags *options);
+int open_ahead(const char *filename, const flags *options);
+int read_ahead_limit(int read_ahead);
+int print_file(int fd, s21c_transformer *transformer, const flags *options);
+int transform_flags(flags options);
+void print_stats(flags options);
 
 #endif
@@ -0,0 +1,223 @@
+#include "s21_cat_lib.h"
+
+#include <string.h>
+
+#include "s21_simd.h"
+
+// bytes that are copied unchanged, newline is always handled separately
+#define S21C_PLAIN(c, flags)                                    \
+  ((c) != '\n' && ((c) != '\t' || !((flags) & S21C_TABS)) &&    \
+   (!((flags) & S21C_NONPRINT) || ((c) >= 32 && (c) < 127) || \
+    (c) == '\t'))
+
+static size_t put_number(char *out, long number) {
+  char digits[24];
+  size_t n = 0, o = 0;
+
+  do {
+    digits[n++] = '0' + number % 10;
+    number /= 10;
+  } while (number);
+  for (size_t pad = n; pad < 6; pad++) out[o++] = ' ';
+  while (n) out[o++] = digits[--n];
+  out[o++] = '\t';
+
+  return o;
+}
+
+static size_t put_special(char *out, unsigned char c, int flags) {
+  size_t o = 0;
+
+  if (c == '\t' && (flags & S21C_TABS)) {
+    out[o++] = '^';
+    out[o++] = 'I';
+  } else {
+    if (c >= 128) {
+      out[o++] = 'M';
+      out[o++] = '-';
+      c -= 128;
+    }
+    if (c < 32) {
+      out[o++] = '^';
+      out[o++] = c + 64;
+    } else if (c == 127) {
+      out[o++] = '^';
+      out[o++] = '?';
+    } else {
+      out[o++] = c;
+    }
+  }
+
+  return o;
+}
+
+// Length of the printable UTF-8 character at text[0] >= 0x80, 0 for C1
+// controls and bytes that are not UTF-8.
+static size_t printable_utf8(const unsigned char *text, size_t len) {
+  size_t n = s21_utf8_length(text, len);
+
+  return n && !(text[0] == 0xc2 && text[1] < 0xa0) ? n : 0;
+}
+
+// True when text[0, len) is the start of a character the input cut off.
+static int cut_off(const unsigned char *text, size_t len) {
+  size_t need = text[0] >= 0xf0 ? 4 : text[0] >= 0xe0 ? 3 : 2;
+  int result = text[0] >= 0xc2 && text[0] <= 0xf4 && len < need;
+
+  for (size_t i = 1; result && i < len; i++) result = (text[i] & 0xc0) == 0x80;
+
+  return result;
+}
+
+static size_t put_held(s21c_transformer *t, char *out, int flags) {
+  size_t o = 0;
+
+  if (printable_utf8(t->held, t->held_len)) {
+    memcpy(out, t->held, t->held_len);
+    o = t->held_len;
+  } else {
+    for (int k = 0; k < t->held_len; k++) o += put_special(out + o, t->held[k], flags);
+  }
+  t->held_len = 0;
+
+  return o;
+}
+
+// Completes the character held from the last call with the bytes fed now.
+static size_t take_held(s21c_transformer *t, const unsigned char *in,
+                        size_t len, size_t *i, char *out, int flags) {
+  while (*i < len && cut_off(t->held, t->held_len) && (in[*i] & 0xc0) == 0x80)
+    t->held[t->held_len++] = in[(*i)++];
+
+  return *i == len && cut_off(t->held, t->held_len) ? 0 : put_held(t, out, flags);
+}
+
+// The one transform loop. Every kernel below inlines it with flags as a
+// constant, so the option tests fold away and each flag combination gets
+// a loop without them.
+static inline __attribute__((always_inline)) size_t transform(
+    s21c_transformer *t, const char *in, size_t len, size_t *consumed,
+    char *out, size_t cap, const int flags) {
+  const unsigned char *src = (const unsigned char *)in;
+  size_t i = 0, o = 0, k;
+
+  if ((flags & S21C_UTF8) && t->held_len) o = take_held(t, src, len, &i, out, flags);
+  while (i < len && cap - o >= S21C_MAX_EXPANSION) {
+    unsigned char c = src[i];
+    if (c == '\n') {
+      if (!((flags & S21C_SQUEEZE) && t->nlc > 1)) {
+        if (t->nlc && (flags & S21C_NUMBER))
+          o += put_number(out + o, ++t->line_number);
+        if (flags & S21C_ENDS) out[o++] = '$';
+        out[o++] = '\n';
+        if (t->nlc < 2) t->nlc++;
+      }
+      i++;
+      continue;
+    }
+
+    if (t->nlc && (flags & (S21C_NUMBER | S21C_NUMBER_NONBLANK)))
+      o += put_number(out + o, ++t->line_number);
+    t->nlc = 0;
+
+    if ((flags & S21C_UTF8) && c >= 0x80 && (k = printable_utf8(src + i, len - i))) {
+      memcpy(out + o, src + i, k);
+      o += k;
+      i += k;
+    } else if ((flags & S21C_UTF8) && c >= 0x80 && cut_off(src + i, len - i)) {
+      t->held_len = len - i;
+      memcpy(t->held, src + i, t->held_len);
+      i = len;
+    } else if (!S21C_PLAIN(c, flags)) {
+      o += put_special(out + o, c, flags);
+      i++;
+    } else {
+      // copy the whole run of unchanged bytes at once
+      size_t run = len - i < cap - o ? len - i : cap - o, n = 1;
+      if (!(flags & (S21C_TABS | S21C_NONPRINT))) {
+        const char *nl = s21_find_newline(in + i, run);
+        n = nl ? (size_t)(nl - (in + i)) : run;
+      } else if (!(flags & S21C_NONPRINT)) {
+        while (n < run && S21C_PLAIN(src[i + n], flags)) n++;
+      } else {
+        // printable ASCII is found a vector at a time; tabs, and with
+        // S21C_UTF8 whole characters, carry the run on
+        while (n < run) {
+          n += s21_printable_prefix(in + i + n, run - n);
+          if (n < run && S21C_PLAIN(src[i + n], flags))
+            n++;
+          else if (n < run && (flags & S21C_UTF8) && src[i + n] >= 0x80 &&
+                   (k = printable_utf8(src + i + n, run - n)))
+            n += k;
+          else
+            break;
+        }
+      }
+      memcpy(out + o, src + i, n);
+      o += n;
+      i += n;
+    }
+  }
+
+  *consumed = i;
+
+  return o;
+}
+
+#define S21C_COMBINATIONS(X)                                               \
+  X(0) X(1) X(2) X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12)     \
+  X(13) X(14) X(15) X(16) X(17) X(18) X(19) X(20) X(21) X(22) X(23) X(24) \
+  X(25) X(26) X(27) X(28) X(29) X(30) X(31) X(32) X(33) X(34) X(35) X(36) \
+  X(37) X(38) X(39) X(40) X(41) X(42) X(43) X(44) X(45) X(46) X(47) X(48) \
+  X(49) X(50) X(51) X(52) X(53) X(54) X(55) X(56) X(57) X(58) X(59) X(60) \
+  X(61) X(62) X(63) X(64) X(65) X(66) X(67) X(68) X(69) X(70) X(71) X(72) \
+  X(73) X(74) X(75) X(76) X(77) X(78) X(79) X(80) X(81) X(82) X(83) X(84) \
+  X(85) X(86) X(87) X(88) X(89) X(90) X(91) X(92) X(93) X(94) X(95) X(96) \
+  X(97) X(98) X(99) X(100) X(101) X(102) X(103) X(104) X(105) X(106)      \
+  X(107) X(108) X(109) X(110) X(111) X(112) X(113) X(114) X(115) X(116)   \
+  X(117) X(118) X(119) X(120) X(121) X(122) X(123) X(124) X(125) X(126)   \
+  X(127)
+
+#define S21C_KERNEL(f)                                                  \
+  static size_t kernel_##f(s21c_transformer *t, const char *in,          \
+                           size_t len, size_t *consumed, char *out,      \
+                           size_t cap) {                                 \
+    return transform(t, in, len, consumed, out, cap, f);                 \
+  }
+#define S21C_KERNEL_ENTRY(f) kernel_##f,
+
+S21C_COMBINATIONS(S21C_KERNEL)
+
+static const s21c_kernel kernels[] = {S21C_COMBINATIONS(S21C_KERNEL_ENTRY)};
+
+void s21c_init(s21c_transformer *t, int flags) {
+  // -b wins over -n, as in the option parser
+  if (flags & S21C_NUMBER_NONBLANK) flags &= ~S21C_NUMBER;
+  if (!(flags & S21C_NONPRINT)) flags &= ~S21C_UTF8;
+  t->flags = flags;
+  // -T without -v scans runs a byte at a time for tabs, which costs the
+  // same with the flags folded or not: those kernels measured no faster
+  // than the generic transform, and sometimes slower
+  if ((flags & S21C_TABS) && !(flags & S21C_NONPRINT))
+    t->kernel = s21c_transform_generic;
+  else
+    t->kernel = kernels[flags & (S21C_KERNEL_COUNT - 1)];
+  t->line_number = 0;
+  t->nlc = 1;
+  t->held_len = 0;
+}
+
+size_t s21c_finish(s21c_transformer *t, char *out) {
+  return t->held_len ? put_held(t, out, t->flags) : 0;
+}
+
+size_t s21c_transform(s21c_transformer *t, const char *in, size_t len,
+                      size_t *consumed, char *out, size_t cap) {
+  return t->kernel(t, in, len, consumed, out, cap);
+}
+
+__attribute__((noinline)) size_t s21c_transform_generic(
+    s21c_transformer *t, const char *in, size_t len, size_t *consumed,
+    char *out, size_t cap) {
+  return transform(t, in, len, consumed, out, cap, t->flags);
+}
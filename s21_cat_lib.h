@@ -0,0 +1,62 @@
+#ifndef S21_CAT_LIB_H
+#define S21_CAT_LIB_H
+
+#include <stddef.h>
+
+// libs21cat: the -n/-b/-s/-v/-E/-T transform as a stateful object. Input
+// may be fed in chunks of any size, from any number of files; line numbers
+// and blank-line squeezing continue across chunk and file boundaries the
+// same way GNU cat continues them across its arguments.
+
+#define S21C_BLOCK_SIZE 65536
+
+// worst case output for one input byte, including a line number prefix
+#define S21C_MAX_EXPANSION 32
+
+#define S21C_NUMBER 1
+#define S21C_NUMBER_NONBLANK 2
+#define S21C_SQUEEZE 4
+#define S21C_NONPRINT 8
+#define S21C_ENDS 16
+#define S21C_TABS 32
+// with S21C_NONPRINT: valid UTF-8 characters are written as they are,
+// C1 controls and bytes that are not UTF-8 still in M- notation
+#define S21C_UTF8 64
+
+// one kernel per flag combination
+#define S21C_KERNEL_COUNT 128
+
+typedef struct s21c_transformer s21c_transformer;
+
+typedef size_t (*s21c_kernel)(s21c_transformer *t, const char *in,
+                              size_t len, size_t *consumed, char *out,
+                              size_t cap);
+
+struct s21c_transformer {
+  int flags;
+  s21c_kernel kernel;  // specialized for flags, picked by s21c_init
+  long line_number;
+  int nlc;  // consecutive newlines before the next byte, 1 at the start
+  unsigned char held[4];  // S21C_UTF8: a character cut off by the end of in
+  int held_len;
+};
+
+void s21c_init(s21c_transformer *t, int flags);
+
+// Transforms in[0, len) into out[0, cap) and returns the bytes written.
+// *consumed tells how much input was used; the rest must be fed again
+// once the caller has drained out. cap must be at least
+// S21C_MAX_EXPANSION for the call to make progress.
+size_t s21c_transform(s21c_transformer *t, const char *in, size_t len,
+                      size_t *consumed, char *out, size_t cap);
+
+// Writes what the last input left held, at most S21C_MAX_EXPANSION bytes,
+// once no more input follows.
+size_t s21c_finish(s21c_transformer *t, char *out);
+
+// The same transform with the flags tested at run time, for benchmarks.
+size_t s21c_transform_generic(s21c_transformer *t, const char *in,
+                              size_t len, size_t *consumed, char *out,
+                              size_t cap);
+
+#endif
@@ -1,23 +1,70 @@
 #include "s21_grep.h"
 
+#include <errno.h>
+
+struct option long_options[] = {{"follow", no_argument, 0, OPT_FOLLOW},
+                                {"io", required_argument, 0, OPT_IO},
+                                {"memory", required_argument, 0, OPT_MEMORY},
+                                {"stats", no_argument, 0, OPT_STATS},
+                                {"null", no_argument, 0, 'Z'},
+                                {"byte-offset", no_argument, 0, 'b'},
+                                {"json", no_argument, 0, OPT_JSON},
+                                {"count-by-pattern", no_argument, 0,
+                                 OPT_COUNT_BY_PATTERN},
+                                {0, 0, 0, 0}};
+
+__thread grep_stats stats;
+
+// getopt keeps its state in globals, so daemon requests parse one at a time
+static pthread_mutex_t parse_lock = PTHREAD_MUTEX_INITIALIZER;
+
 int main(int argc, char *argv[]) {
-  char get_opt;
-  int error = 0, count_templates = 0;
-  regex_t templates[MAX_COUNT_TEMPLATES];
-  flags options = {0, 0, 0, 0, 0, 0, 0, 0, 0, "", 0};
+  // the patterns are compiled for the environment's character set
+  setlocale(LC_ALL, "");
+  if (argc > 1 && !strncmp(argv[1], "--daemon=", 9)) {
+    // --daemon=SOCKET [--memory=SIZE], the budget for its file copies
+    size_t memory = 0;
+    if (argc > 3 || (argc == 3 && (strncmp(argv[2], "--memory=", 9) ||
+                                   !(memory = s21_parse_memory(argv[2] + 9))))) {
+      fprintf(stderr, "grep: usage: s21_grep --daemon=SOCKET [--memory=SIZE]\n");
+      return 2;
+    }
+    return serve(argv[1] + 9, memory);
+  }
+  if (argc > 1 && !strncmp(argv[1], "--server=", 9))
+    return ask_server(argv[1] + 9, argc - 1, argv + 1);
 
-  while (!error && (get_opt = getopt(argc, argv, ":e:ivclnhsf:o")) != -1) {
+  return grep(argc, argv, NULL);
+}
+
+// One s21_grep run, in the process or for a daemon client. With a cache the
+// patterns come compiled from it and files from its copies.
+int grep(int argc, char *argv[], daemon_cache *cache) {
+  char error_text[256];
+  int get_opt, error = 0, op_index = 0, arg;
+  templates_list list = {0};
+  s21g_patterns own = {0}, *patterns = &own;
+  flags options = {.cache = cache};
+  // -e and -f in command line order; -f files are read once the lock is
+  // released, so a slow one doesn't hold up other daemon requests
+  template_arg *args = malloc(argc * sizeof(template_arg));
+  int arg_count = 0;
+
+  stats = (grep_stats){0};
+  error = !args;
+  pthread_mutex_lock(&parse_lock);
+  optind = 0;
+  while (!error && (get_opt = getopt_long(argc, argv, ":e:ivclnhsf:owxZbP",
+                                          long_options, &op_index)) != -1) {
     switch (get_opt) {
       case 'f':
         options.f = 1;
         options.f_argument = optarg;
-        if ((error = read_file_templates(templates, &count_templates, optarg, options)))
-          printf("%s: No such file or directory\n", optarg);
+        args[arg_count++] = (template_arg){1, optarg};
         break;
       case 'e':
         options.e = 1;
-        regcomp(&templates[count_templates++], optarg,
-                options.i ? REG_ICASE : REG_EXTENDED);
+        args[arg_count++] = (template_arg){0, optarg};
         break;
       case 'i':
         options.i = 1;
@@ -43,129 +90,421 @@ int main(int argc, char *argv[]) {
       case 'o':
         options.o = 1;
         break;
+      case 'w':
+        options.w = 1;
+        break;
+      case 'x':
+        options.x = 1;
+        break;
+      case 'Z':
+        options.null = 1;
+        break;
+      case 'b':
+        options.b = 1;
+        break;
+      case 'P':
+        options.perl = 1;
+        break;
+      case OPT_JSON:
+        options.json = 1;
+        break;
+      case OPT_COUNT_BY_PATTERN:
+        options.by_pattern = 1;
+        break;
+      case OPT_FOLLOW:
+        options.follow = 1;
+        break;
+      case OPT_IO:
+        error = parse_io(optarg, &options);
+        break;
+      case OPT_MEMORY:
+        error = !(options.memory = s21_parse_memory(optarg));
+        break;
+      case OPT_STATS:
+        options.stats = 1;
+        break;
       default:
         error = 1;
         break;
     }
   }
 
-  if (!error && (optind + 1 - (options.f || options.e)) < argc) {
-    if (!(options.f || options.e))
-      regcomp(&templates[count_templates++], argv[optind++],
-              options.i ? REG_ICASE : REG_EXTENDED);
-    if (optind == argc - 1) options.h = 1;
-    while (optind < argc) {
-      if (print_matches(templates, count_templates, argv[optind], options) && !options.s)
-        printf("grep: %s: No such file or directory\n", argv[optind]);
-      optind++;
-    }
-  } else
-   printf("Error!");
-
-  free_templates(templates, count_templates);
-
-  return 0;
-}
-
-int print_matches(regex_t *templates, int count_templates, char *filename, flags options) {
-  int result, line_len, line_count = 0, match_count = 0, offset = 0;
-  char line[MAX_LINE_LENGTH], match = 0;
-  FILE *f = fopen(filename, "r");
-
-  !f ? (result = 0) : (result = 1);
-
-    // if (options.f) {
-    // // Вывод файла целиком
-    //   if (strcmp(filename, options.f_argument) == 0) {
-    //     rewind(f); // Сбрасываем указатель файла в начало
-    //     while (fgets(line, MAX_LINE_LENGTH, f) != NULL) {
-    //       fputs(line, stdout);
-    //     }
-    //   }
-    //   return result;
-  // } else {
-    while (result && feof(f) == 0 && fgets(line, MAX_LINE_LENGTH, f) != NULL) {
-      match = 0;
-      line_len = strlen(line);
-      line_count++;
-      for (int i = 0; i < count_templates; i++) {
-        offset = 0;
-        regmatch_t regmatch;
-        while (!regexec(&templates[i], &line[offset], 1 , &regmatch, 0)) {
-            if (options.o && !options.v && !options.c && !options.l) {
-              if (!offset && !options.h) printf("%s:", filename);
-              if (!offset && options.n) printf("%d:", line_count);
-              while (regmatch.rm_so < regmatch.rm_eo) {
-                printf("%c", line[offset + regmatch.rm_so]);
-                regmatch.rm_so++;
-              }
-              printf("\n");
-            }
-            match = 1;
-            offset += regmatch.rm_eo;
-          }
-      }
-      // Вместо простого вывода строки используем fputs для вывода строки с сохранением перевода строки
-      // fputs(line, stdout);
-      if (options.v) match = !match;
-
-      match_count += match;
-
-      if (match && !options.c && !options.l && (!options.o || options.v) && !(options.o && options.v)) {
-        if (!options.h) printf("%s:", filename);
-        if (options.n) printf("%d:", line_count);
-        for (int i = 0; i < line_len && line[i] != '\n'; i++)
-          printf("%c", line[i]);
-        printf("\n");
-      }
+  arg = optind;
+  pthread_mutex_unlock(&parse_lock);
+
+  for (int i = 0; !error && i < arg_count; i++)
+    if (!args[i].file) {
+      error = add_template(&list, args[i].text);
+    } else if ((error = read_file_templates(&list, args[i].text))) {
+      fprintf(output_stream(), "%s: No such file or directory\n", args[i].text);
     }
+  free(args);
+
+  // the daemon reads each file whole from its cache
+  if (cache) options.io = S21_IO_SYNC;
 
-    if (options.c && !options.l) {
-      if (!options.h) printf("%s:", filename);
-      if (options.l) match_count = 1;
-      printf("%d\n", match_count);
+  if (!error && (arg + 1 - (options.f || options.e)) < argc) {
+    if (!(options.f || options.e)) add_template(&list, argv[arg++]);
+    if (arg == argc - 1) options.h = 1;
+    // what the compiled set keeps on the heap counts against --memory
+    size_t heap = heap_in_use(), compiled = 0;
+    if (cache)
+      error = !(patterns = cache_patterns(cache, list.sources, list.count,
+                                          compile_flags(options), error_text,
+                                          sizeof(error_text), &compiled));
+    else if (!(error = s21g_compile(&own, list.sources, list.count, compile_flags(options),
+                                    error_text, sizeof(error_text))))
+      compiled = heap_in_use() - heap;
+    plan_memory(&options, &list, compiled, argc - arg);
+    if (error) fprintf(output_stream(), "grep: %s\n", error_text);
+    if (!patterns) patterns = &own;
+    options.patterns = patterns;
+    options.sources = list.sources;
+    if (!error && options.by_pattern && !(options.counts = calloc(list.count, sizeof(long))))
+      error = 1;
+    // a daemon worker can't wait on a followed file forever
+    if (!error && options.follow && cache) {
+      fprintf(output_stream(), "grep: --follow is not served by the daemon\n");
+      error = 1;
     }
+    // counts are only reported once a file is complete, so they don't follow
+    if (!error && options.follow && !options.c && !options.l && !options.by_pattern) {
+      error = follow_files(patterns, argv + arg, argc - arg, search_mode(options),
+                           options);
+      arg = argc;
+    }
+    // files the read-ahead leaves (it may fail to start or stop short) are
+    // searched one by one
+    if (!error && options.io != S21_IO_SYNC && argc - arg >= S21_IO_MIN_FILES)
+      arg += search_files(patterns, argv + arg, argc - arg, options);
+    while (!error && arg < argc) print_matches(patterns, argv[arg++], options);
+    if (options.stats) print_stats(options);
+  } else {
+    fprintf(output_stream(), "Error!");
+    error = 1;
+  }
 
-    if (options.l)
-      if (match_count > 0) printf("%s\n", filename);
+  if (patterns != &own) release_patterns(cache, patterns);
+  s21g_free(&own);
+  free_templates(&list);
+  free(options.counts);
 
-    if (result) fclose(f);
+  return error || stats.failed ? 2 : !stats.selected;
+}
+
+int compile_flags(flags options) {
+  int utf8 = MB_CUR_MAX > 1 && !strcmp(nl_langinfo(CODESET), "UTF-8");
+
+  return (options.i ? S21G_ICASE : 0) | (options.w ? S21G_WORD : 0) |
+         (options.x ? S21G_LINE : 0) | (options.perl ? S21G_PERL : 0) |
+         (utf8 ? S21G_UTF8 : 0);
+}
+
+int search_mode(flags options) {
+  int mode = options.v ? S21G_INVERT : 0;
+
+  // --count-by-pattern counts matches instead of lines with -o
+  if (options.by_pattern)
+    return mode | S21G_PER_PATTERN | (options.o && !options.v ? S21G_EACH_MATCH : 0);
+
+  // --json reports every span of a line itself, and always a line number
+  if (options.o && !options.v && !options.c && !options.l && !options.json)
+    mode |= S21G_EACH_MATCH;
+  if (options.n || options.json) mode |= S21G_LINE_NUMBERS;
+  // without a prefix per line, runs of inverted lines are written whole
+  if (options.v && options.h && !options.b) mode |= S21G_SPANS;
+
+  return mode;
+}
+
+// -c only needs the count the search returns
+s21g_callback line_callback(flags options) {
+  return (options.c && !options.l) || options.by_pattern ? NULL : print_line;
+}
+
+// Hands the search the per-pattern counts when --count-by-pattern wants them.
+void search_counts(s21g_search *search, flags options) {
+  if (options.by_pattern) search->counts = options.counts;
+}
 
-    return !result;
-  // }
+// In the daemon a regular file is searched in the cache's copy of it.
+// A file that can't be opened is reported and skipped. One that fails
+// while it is read, such as a directory, is reported and still gets its
+// totals, as with GNU grep; either way grep exits 2.
+void file_error(const char *filename, int error, flags options) {
+  if (!options.s) fprintf(output_stream(), "grep: %s: %s\n", filename, s21g_strerror(error));
+  stats.failed++;
 }
 
-void free_templates(regex_t *templates, int count) {
-  for (int i = 0; i < count; i++) regfree(&templates[i]);
+int print_matches(s21g_patterns *patterns, char *filename, flags options) {
+  int error = 0;
+  long match_count = 0;
+  s21g_search search;
+  s21g_stream stream;
+  const char *data = NULL;
+  size_t len = 0;
+  void *copy = options.cache ? cache_file(options.cache, filename, &data, &len) : NULL;
+  FILE *f = copy ? NULL : fopen(filename, "r");
+
+  if (!f && !copy) {
+    file_error(filename, errno, options);
+    return 1;
+  }
+
+  s21g_search_init(&search, patterns, search_mode(options),
+                   line_callback(options), &options);
+  search_counts(&search, options);
+  s21g_search_reset(&search, filename);
+  s21g_stream_init(&stream);
+  stream.max_line = options.max_line;
+
+  if (copy)
+    match_count = s21g_stream_feed(&search, &stream, data, len);
+  else
+    match_count = s21g_stream_read(&search, &stream, fileno(f));
+  if (match_count >= 0) match_count = s21g_stream_finish(&search, &stream);
+  if (match_count < 0) {
+    error = search.error;
+    match_count = 0;
+  }
+  note_stream(&stream);
+  s21g_stream_free(&stream);
+
+  if (error) file_error(filename, error, options);
+  print_totals(filename, match_count, options);
+  stats.selected += match_count;
+
+  if (f) fclose(f);
+  if (copy) release_file(options.cache, copy);
+
+  return error != 0;
 }
 
-int read_file_templates(regex_t *templates, int *count_templates, char *filename, flags options) {
+int parse_io(const char *mode, flags *options) {
   int result = 1;
-  char line[MAX_LINE_LENGTH];
-  FILE *f = fopen(filename, "r");
 
-  if (!f) {
+  if (!strcmp(mode, "auto"))
+    options->io = S21_IO_AUTO;
+  else if (!strcmp(mode, "uring"))
+    options->io = S21_IO_URING;
+  else if (!strcmp(mode, "threads"))
+    options->io = S21_IO_THREADS;
+  else if (!strcmp(mode, "sync"))
+    options->io = S21_IO_SYNC;
+  else
     result = 0;
-  } else {
-    options.f_argument = filename;
-    while (result && fgets(line, MAX_LINE_LENGTH, f)) {
-      // Ignore lines starting with a newline character
-      // if (line[0] == '\n') {
-      //   continue;
-      // }
-      //
-      // // Remove newline character if present
-      // size_t length = strlen(line);
-      // if (length > 0 && line[length - 1] == '\n') {
-      //   line[length - 1] = '\0';
-      // }
-
-      regcomp(&templates[(*count_templates)++], line, options.i ? REG_ICASE : REG_EXTENDED);
+
+  return !result;
+}
+
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+// the sanitizers replace malloc, and mallinfo2 with it
+size_t __sanitizer_get_current_allocated_bytes(void);
+
+size_t heap_in_use(void) { return __sanitizer_get_current_allocated_bytes(); }
+#else
+// Bytes malloc has handed out and not taken back, across every arena.
+size_t heap_in_use(void) {
+  struct mallinfo2 heap = mallinfo2();
+
+  return heap.uordblks + heap.hblkhd;
+}
+#endif
+
+// Splits --memory between the buffers s21_grep sizes itself. The pattern
+// sources and what compiling them kept on the heap are charged first; the rest goes to line buffers, half of it to
+// read-ahead slots when many files are read ahead. Each still gets one
+// block or one slot, so a budget the patterns use up stops the buffers
+// from growing rather than failing the search. Every file in flight also
+// holds a descriptor, so the window stays under RLIMIT_NOFILE (shared by
+// the daemon's workers).
+void plan_memory(flags *options, const templates_list *list, size_t compiled,
+                 int files) {
+  size_t rest = options->memory, lines, slots;
+  int read_ahead = !options->follow && options->io != S21_IO_SYNC &&
+                   files >= S21_IO_MIN_FILES;
+  struct rlimit limit;
+
+  stats.pattern_bytes = list->capacity * sizeof(char *) + compiled;
+  for (int i = 0; i < list->count; i++)
+    stats.pattern_bytes += strlen(list->sources[i]) + 1;
+  options->max_line = S21G_MAX_LINE;
+  options->window = S21_IO_WINDOW;
+  if (rest) {
+    rest = rest > stats.pattern_bytes ? rest - stats.pattern_bytes : 0;
+    slots = read_ahead ? rest / 2 / S21_IO_SLOT_SIZE : 0;
+    // --follow keeps a stream per file; each can read back one block
+    lines = (read_ahead ? rest / 2 : rest) / (options->follow ? files : 1);
+    lines = lines > S21G_BLOCK_SIZE ? lines - S21G_BLOCK_SIZE : 0;
+    if (slots < (size_t)options->window) options->window = slots ? slots : 1;
+    if (lines < options->max_line)
+      options->max_line = lines > S21G_BLOCK_SIZE ? lines : S21G_BLOCK_SIZE;
+  }
+  if (!getrlimit(RLIMIT_NOFILE, &limit) && limit.rlim_cur != RLIM_INFINITY) {
+    rlim_t spare = limit.rlim_cur > S21_IO_RESERVED_FDS
+                       ? limit.rlim_cur - S21_IO_RESERVED_FDS : 0;
+    if (options->cache) spare /= S21_DAEMON_THREADS;
+    if (spare < (rlim_t)options->window) options->window = spare ? spare : 1;
+  }
+}
+
+void note_stream(const s21g_stream *stream) {
+  size_t used = stream->cap + (stream->replay ? S21G_BLOCK_SIZE : 0);
+
+  if (used > stats.line_peak) stats.line_peak = used;
+  if (stream->whole_peak > stats.whole_peak) stats.whole_peak = stream->whole_peak;
+}
+
+void print_stats(flags options) {
+  fflush(output_stream());
+  if (options.memory)
+    fprintf(error_stream(), "memory budget: %zu bytes\n", options.memory);
+  else
+    fprintf(error_stream(), "memory budget: none\n");
+  fprintf(error_stream(), "patterns: %zu bytes\n", stats.pattern_bytes);
+  fprintf(error_stream(), "line buffer: peak %zu bytes, lines over %zu searched in windows\n",
+          stats.line_peak, options.max_line);
+  // a mapping outside the budget (see S21G_MAX_LINE)
+  if (stats.whole_peak)
+    fprintf(error_stream(), "long lines searched whole: longest %zu bytes, outside the budget\n",
+            stats.whole_peak);
+  fprintf(error_stream(), "read-ahead: peak %d of %d files in flight, %zu bytes each\n",
+          stats.window_peak, options.window, (size_t)S21_IO_SLOT_SIZE);
+  fprintf(error_stream(), "peak RSS: %ld KiB\n", s21_peak_rss());
+}
+
+int add_template(templates_list *list, char *source) {
+  int result = 1;
+  char **grown;
+
+  if (list->count == list->capacity) {
+    int capacity = list->capacity ? list->capacity * 2 : 64;
+    if ((grown = realloc(list->sources, capacity * sizeof(char *)))) {
+      list->sources = grown;
+      list->capacity = capacity;
+    } else {
+      result = 0;
     }
+  }
+  if (result) list->sources[list->count++] = source;
+
+  return !result;
+}
+
+int add_region(templates_list *list, void *addr, size_t len) {
+  int result = 1;
+  region *grown = realloc(list->regions, (list->count_regions + 1) * sizeof(region));
+
+  if (grown) {
+    list->regions = grown;
+    list->regions[list->count_regions].addr = addr;
+    list->regions[list->count_regions++].len = len;
+  } else {
+    result = 0;
+  }
 
-    fclose(f);
+  return !result;
+}
+
+void free_templates(templates_list *list) {
+  for (int i = 0; i < list->count_regions; i++) {
+    if (list->regions[i].len)
+      munmap(list->regions[i].addr, list->regions[i].len);
+    else
+      free(list->regions[i].addr);
+  }
+  free(list->regions);
+  free(list->sources);
+  list->regions = NULL;
+  list->sources = NULL;
+  list->count_regions = list->count = list->capacity = 0;
+}
+
+// Splits text[0, len) into patterns in place: newlines become NUL
+// terminators, so no line is copied and any line length works. Only a last
+// line without a newline has its terminator at text[len], when room says
+// it is writable, else it is copied.
+static int split_templates(templates_list *list, char *text, size_t len, int room) {
+  int result = 1;
+  char *end = text + len, *line, *nl, *copy;
+
+  for (line = text; result && line < end; line = nl + 1) {
+    if ((nl = memchr(line, '\n', end - line))) {
+      *nl = '\0';
+    } else if (room) {
+      nl = end;
+      *nl = '\0';
+    } else {
+      nl = end;
+      copy = strndup(line, end - line);
+      result = copy && !add_region(list, copy, 0);
+      line = copy;
+    }
+    if (result) result = !add_template(list, line);
   }
 
   return !result;
 }
 
+// A pipe, FIFO or terminal has no size to map: it is read to its end.
+static char *read_all(int fd, size_t *len) {
+  size_t cap = 0;
+  ssize_t n = 1;
+  char *text = NULL, *grown;
+
+  *len = 0;
+  while (n > 0) {
+    if (*len + 1 >= cap) {
+      cap = cap ? cap * 2 : 65536;
+      if (!(grown = realloc(text, cap))) break;
+      text = grown;
+    }
+    n = read(fd, text + *len, cap - *len - 1);
+    if (n > 0) *len += n;
+  }
+  if (n) {
+    free(text);
+    text = NULL;
+  }
+
+  return text;
+}
+
+// A regular pattern file is mapped privately and split in place; the zero
+// fill after EOF gives the last line its terminator unless the file ends
+// exactly on a page boundary.
+int read_file_templates(templates_list *list, char *filename) {
+  int result = 1;
+  struct stat st;
+  char *map = NULL, *text = NULL;
+  size_t len = 0;
+  int fd = open(filename, O_RDONLY);
+
+  if (fd < 0 || fstat(fd, &st)) result = 0;
+  if (result && S_ISREG(st.st_mode) && st.st_size > 0) {
+    len = st.st_size;
+    map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED || add_region(list, map, len)) {
+      if (map != MAP_FAILED) munmap(map, len);
+      map = NULL;
+      result = 0;
+    }
+  } else if (result) {
+    text = read_all(fd, &len);
+    if (!text || add_region(list, text, 0)) {
+      free(text);
+      text = NULL;
+      result = 0;
+    }
+  }
+  if (fd >= 0) close(fd);
+
+  if (map) {
+    madvise(map, len, MADV_SEQUENTIAL);
+    result = !split_templates(list, map, len, len % sysconf(_SC_PAGESIZE) != 0);
+  } else if (text) {
+    result = !split_templates(list, text, len, 1);
+  }
+
+  return !result;
+}
@@ -1,11 +1,54 @@
+#ifndef S21_GREP_H
+#define S21_GREP_H
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
 #include <getopt.h>
-#include <regex.h>
+#include <langinfo.h>
+#include <locale.h>
+#include <malloc.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "s21_grep_lib.h"
+#include "s21_memory.h"
+
+// long-only options
+#define OPT_FOLLOW 256
+#define OPT_IO 257
+#define OPT_MEMORY 258
+#define OPT_STATS 259
+#define OPT_JSON 260
+#define OPT_COUNT_BY_PATTERN 261
+
+// --io: how many-file searches read ahead (s21_grep_io.c)
+#define S21_IO_AUTO 0
+#define S21_IO_URING 1
+#define S21_IO_THREADS 2
+#define S21_IO_SYNC 3
+
+#define S21_IO_MIN_FILES 4
+#define S21_IO_WINDOW 64
+#define S21_IO_SLOT_SIZE 65536
+#define S21_IO_THREAD_COUNT 8
+// descriptors left to everything but the files in flight
+#define S21_IO_RESERVED_FDS 16
 
-#define MAX_COUNT_TEMPLATES 1024
-#define MAX_LINE_LENGTH 2048
+// --daemon (s21_grep_daemon.c): worker threads, and what stays cached
+// between requests (file copies up to --memory when the daemon gets one)
+#define S21_DAEMON_THREADS 8
+#define S21_DAEMON_PATTERN_SETS 64
+#define S21_DAEMON_FILES 4096
+#define S21_DAEMON_FILE_BYTES (256 << 20)
+
+typedef struct daemon_cache daemon_cache;
 
 typedef struct {
   int e;
@@ -19,8 +62,104 @@ typedef struct {
   int f;
   char *f_argument;
   int o;
+  int w;
+  int x;
+  int follow;
+  int io;
+  size_t memory;    // --memory budget, 0 for none
+  int stats;
+  size_t max_line;  // line buffer cap per stream, from plan_memory
+  int window;       // read-ahead files in flight, from plan_memory
+  int null;         // -Z: NUL after file names
+  int b;
+  int json;
+  int perl;  // -P
+  int by_pattern;  // --count-by-pattern
+  const s21g_patterns *patterns;  // for the --json match spans
+  char **sources;  // pattern texts, for --count-by-pattern
+  long *counts;  // per pattern, for the file being searched
+  daemon_cache *cache;  // in the daemon: warm patterns and file copies
 } flags;
 
-int print_matches(regex_t *templates, int count_templates, char *filename, flags options);
-int read_file_templates(regex_t *templates, int *count_templates, char *filename, flags options);
-void free_templates(regex_t *templates, int count);
+// --stats: what the buffers reached, printed on stderr at exit; the run
+// totals also make the exit status (0 selected, 1 none, 2 trouble). Each
+// thread has its own, as daemon workers run searches side by side.
+typedef struct {
+  size_t pattern_bytes;
+  size_t line_peak;
+  size_t whole_peak;  // the longest line mapped to be searched whole
+  int window_peak;
+  long selected;
+  int failed;  // files that could not be read
+} grep_stats;
+
+extern __thread grep_stats stats;
+
+extern struct option long_options[];
+
+typedef struct file_reader file_reader;
+
+typedef struct {
+  void *addr;
+  size_t len;  // mapped length, 0 for malloc'ed memory
+} region;
+
+typedef struct {
+  char **sources;
+  int count;
+  int capacity;
+  region *regions;  // -f file contents behind sources
+  int count_regions;
+} templates_list;
+
+// an -e pattern or an -f file, as given
+typedef struct {
+  int file;
+  char *text;
+} template_arg;
+
+int grep(int argc, char *argv[], daemon_cache *cache);
+int print_matches(s21g_patterns *patterns, char *filename, flags options);
+void file_error(const char *filename, int error, flags options);
+int print_line(const s21g_match *match, void *data);
+int search_mode(flags options);
+s21g_callback line_callback(flags options);
+void print_totals(const char *filename, long match_count, flags options);
+void set_streams(FILE *output_to, FILE *errors_to);
+FILE *output_stream(void);
+FILE *error_stream(void);
+void search_counts(s21g_search *search, flags options);
+int parse_io(const char *mode, flags *options);
+int follow_files(s21g_patterns *patterns, char **filenames, int count,
+                 int mode, flags options);
+int compile_flags(flags options);
+size_t heap_in_use(void);
+void plan_memory(flags *options, const templates_list *list, size_t compiled,
+                 int files);
+void note_stream(const s21g_stream *stream);
+void print_stats(flags options);
+file_reader *reader_start(char **filenames, int count, int backend,
+                          int window);
+int reader_next(file_reader *reader, const char **filename, int *fd,
+                const char **data, ssize_t *len, int *error);
+void reader_release(file_reader *reader);
+void reader_stop(file_reader *reader);
+int search_files(s21g_patterns *patterns, char **filenames, int count,
+                 flags options);
+
+int serve(const char *path, size_t memory);
+int ask_server(const char *path, int argc, char *argv[]);
+s21g_patterns *cache_patterns(daemon_cache *cache, char **sources, int count,
+                              int flags, char *error, size_t error_size,
+                              size_t *footprint);
+void release_patterns(daemon_cache *cache, s21g_patterns *patterns);
+void *cache_file(daemon_cache *cache, const char *filename, const char **data,
+                 size_t *len);
+void release_file(daemon_cache *cache, void *file);
+
+int add_template(templates_list *list, char *source);
+int add_region(templates_list *list, void *addr, size_t len);
+int read_file_templates(templates_list *list, char *filename);
+void free_templates(templates_list *list);
+
+#endif
@@ -0,0 +1,428 @@
+#include "s21_grep.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// --daemon=SOCKET serves searches over a Unix socket, --server=SOCKET sends
+// one. The client passes its working directory, stdout and stderr along
+// with its arguments, so a worker writes the results straight to the
+// client's output and only the exit status comes back. Between requests
+// the daemon keeps compiled pattern sets, found again by their text and
+// flags, and copies of the files it searched, checked against their size
+// and mtime. Copies rather than mappings: a log truncated under a mapping
+// would take the whole daemon down with SIGBUS. The copies take up to
+// S21_DAEMON_FILE_BYTES, or the --memory given after --daemon=SOCKET; a
+// request's own --memory only sizes its buffers.
+
+typedef struct pattern_set {
+  struct pattern_set *next;  // most recently used first
+  char *key;  // flags, then every source, each NUL-terminated
+  size_t key_len;
+  s21g_patterns patterns;
+  size_t footprint;  // heap the compile kept, see heap_in_use
+  int users;
+} pattern_set;
+
+typedef struct file_copy {
+  struct file_copy *next;  // most recently used first
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  struct timespec mtime;
+  char *data;  // size bytes and a NUL
+  int users;
+  int stale;  // out of the list, freed by its last user
+} file_copy;
+
+struct daemon_cache {
+  pthread_mutex_t lock;
+  pattern_set *sets;
+  int set_count;
+  file_copy *files;
+  int file_count;
+  size_t file_bytes;
+  size_t file_limit;  // the most file_bytes may reach
+};
+
+typedef struct {
+  int fd;
+  daemon_cache *cache;
+} server;
+
+static char *pattern_key(char **sources, int count, int flags, size_t *len) {
+  char *key, *p;
+
+  *len = 12;
+  for (int i = 0; i < count; i++) *len += strlen(sources[i]) + 1;
+  if ((key = p = malloc(*len))) {
+    p += snprintf(p, 12, "%d", flags) + 1;
+    for (int i = 0; i < count; i++) p = stpcpy(p, sources[i]) + 1;
+    *len = p - key;
+  }
+
+  return key;
+}
+
+// Drops the least recently used entries nobody is searching with until the
+// list is back under its limits.
+static void evict_sets(daemon_cache *cache) {
+  pattern_set **link, **last;
+
+  while (cache->set_count > S21_DAEMON_PATTERN_SETS) {
+    last = NULL;
+    for (link = &cache->sets; *link; link = &(*link)->next)
+      if (!(*link)->users) last = link;
+    if (!last) break;
+    pattern_set *set = *last;
+    *last = set->next;
+    s21g_free(&set->patterns);
+    free(set->key);
+    free(set);
+    cache->set_count--;
+  }
+}
+
+// A set is compiled outside the lock; two requests that miss at once both
+// compile it and the second copy simply ages out. *footprint gets the heap
+// the set holds, measured across its compile; other workers allocating or
+// freeing meanwhile blur that figure.
+s21g_patterns *cache_patterns(daemon_cache *cache, char **sources, int count,
+                              int flags, char *error, size_t error_size,
+                              size_t *footprint) {
+  size_t heap = heap_in_use(), now;
+  size_t key_len;
+  char *key = pattern_key(sources, count, flags, &key_len);
+  pattern_set **link, *set = NULL;
+
+  if (!key) {
+    snprintf(error, error_size, "out of memory");
+    return NULL;
+  }
+  pthread_mutex_lock(&cache->lock);
+  for (link = &cache->sets; *link && !set; link = set ? link : &(*link)->next)
+    if ((*link)->key_len == key_len && !memcmp((*link)->key, key, key_len)) set = *link;
+  if (set) {
+    *link = set->next;
+    set->next = cache->sets;
+    cache->sets = set;
+    set->users++;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  if (set) {
+    free(key);
+  } else if (!(set = calloc(1, sizeof(pattern_set)))) {
+    snprintf(error, error_size, "out of memory");
+    free(key);
+  } else if (s21g_compile(&set->patterns, sources, count, flags, error, error_size)) {
+    free(set);
+    free(key);
+    set = NULL;
+  } else {
+    set->footprint = (now = heap_in_use()) > heap ? now - heap : 0;
+    set->key = key;
+    set->key_len = key_len;
+    set->users = 1;
+    pthread_mutex_lock(&cache->lock);
+    set->next = cache->sets;
+    cache->sets = set;
+    cache->set_count++;
+    evict_sets(cache);
+    pthread_mutex_unlock(&cache->lock);
+  }
+
+  if (set) *footprint = set->footprint;
+  return set ? &set->patterns : NULL;
+}
+
+void release_patterns(daemon_cache *cache, s21g_patterns *patterns) {
+  pattern_set *set = (pattern_set *)((char *)patterns - offsetof(pattern_set, patterns));
+
+  pthread_mutex_lock(&cache->lock);
+  set->users--;
+  evict_sets(cache);
+  pthread_mutex_unlock(&cache->lock);
+}
+
+static void unlink_file(daemon_cache *cache, file_copy **link) {
+  file_copy *file = *link;
+
+  *link = file->next;
+  cache->file_count--;
+  cache->file_bytes -= file->size;
+  file->stale = 1;
+  if (!file->users) {
+    free(file->data);
+    free(file);
+  }
+}
+
+static void evict_files(daemon_cache *cache) {
+  file_copy **link, **last;
+
+  while (cache->file_count > S21_DAEMON_FILES ||
+         cache->file_bytes > cache->file_limit) {
+    last = NULL;
+    for (link = &cache->files; *link; link = &(*link)->next)
+      if (!(*link)->users) last = link;
+    if (!last) break;
+    unlink_file(cache, last);
+  }
+}
+
+static file_copy *read_copy(const char *filename, size_t limit) {
+  struct stat st;
+  file_copy *file = NULL;
+  int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  size_t done = 0;
+  ssize_t n = 1;
+
+  if (fd >= 0 && !fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0 &&
+      (size_t)st.st_size <= limit && (file = calloc(1, sizeof(file_copy))) &&
+      (file->data = malloc(st.st_size + 1))) {
+    while (done < (size_t)st.st_size &&
+           (n = read(fd, file->data + done, st.st_size - done)) > 0)
+      done += n;
+  }
+  if (file && (!file->data || done != (size_t)st.st_size)) {
+    // shrank while it was read: searched the usual way instead
+    free(file->data);
+    free(file);
+    file = NULL;
+  }
+  if (file) {
+    file->data[done] = '\0';
+    file->dev = st.st_dev;
+    file->ino = st.st_ino;
+    file->size = st.st_size;
+    file->mtime = st.st_mtim;
+    file->users = 1;
+  }
+  if (fd >= 0) close(fd);
+
+  return file;
+}
+
+// The cached copy of a regular file, read in on a miss; NULL for anything
+// else, which the caller then reads itself.
+void *cache_file(daemon_cache *cache, const char *filename, const char **data,
+                 size_t *len) {
+  struct stat st;
+  file_copy **link, *file = NULL;
+
+  if (stat(filename, &st) || !S_ISREG(st.st_mode)) return NULL;
+  pthread_mutex_lock(&cache->lock);
+  for (link = &cache->files; *link; link = &(*link)->next)
+    if ((*link)->dev == st.st_dev && (*link)->ino == st.st_ino) break;
+  if (*link && (*link)->size == st.st_size &&
+      (*link)->mtime.tv_sec == st.st_mtim.tv_sec &&
+      (*link)->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+    file = *link;
+    *link = file->next;
+    file->next = cache->files;
+    cache->files = file;
+    file->users++;
+  } else if (*link) {
+    unlink_file(cache, link);
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  if (!file && (file = read_copy(filename, cache->file_limit))) {
+    pthread_mutex_lock(&cache->lock);
+    file->next = cache->files;
+    cache->files = file;
+    cache->file_count++;
+    cache->file_bytes += file->size;
+    evict_files(cache);
+    pthread_mutex_unlock(&cache->lock);
+  }
+  if (file) {
+    *data = file->data;
+    *len = file->size;
+  }
+
+  return file;
+}
+
+void release_file(daemon_cache *cache, void *copy) {
+  file_copy *file = copy;
+
+  pthread_mutex_lock(&cache->lock);
+  if (!--file->users && file->stale) {
+    free(file->data);
+    free(file);
+  } else {
+    evict_files(cache);
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+// A request is the arguments, argv[0] first, each NUL-terminated; the first
+// message carries the directory, stdout and stderr descriptors.
+static char *read_request(int client, int fds[3], size_t *len) {
+  char control[CMSG_SPACE(3 * sizeof(int))], *request = malloc(4096), *grown;
+  size_t cap = 4096;
+  struct iovec iov = {request, cap};
+  struct msghdr message = {.msg_iov = &iov, .msg_iovlen = 1,
+                           .msg_control = control, .msg_controllen = sizeof(control)};
+  struct cmsghdr *header;
+  ssize_t n = request ? recvmsg(client, &message, MSG_CMSG_CLOEXEC) : -1;
+
+  header = n > 0 ? CMSG_FIRSTHDR(&message) : NULL;
+  if (header && header->cmsg_type == SCM_RIGHTS &&
+      header->cmsg_len == CMSG_LEN(3 * sizeof(int)))
+    memcpy(fds, CMSG_DATA(header), 3 * sizeof(int));
+  for (*len = 0; n > 0; n = read(client, request + *len, cap - *len)) {
+    *len += n;
+    if (*len == cap && (grown = realloc(request, cap *= 2))) {
+      request = grown;
+    } else if (*len == cap) {
+      n = -1;
+      break;
+    }
+  }
+  if (n < 0 || !*len || request[*len - 1]) {
+    free(request);
+    request = NULL;
+  }
+
+  return request;
+}
+
+static void serve_client(daemon_cache *cache, int client) {
+  int fds[3] = {-1, -1, -1}, argc = 0;
+  size_t len;
+  char *request = read_request(client, fds, &len), **argv = NULL;
+  unsigned char status = 2;
+  FILE *output = NULL, *errors = NULL;
+
+  for (size_t i = 0; request && i < len; i++) argc += !request[i];
+  if (request && fds[2] >= 0 && (argv = malloc((argc + 1) * sizeof(char *)))) {
+    for (int i = 0, at = 0; i < argc; i++, at += strlen(request + at) + 1)
+      argv[i] = request + at;
+    argv[argc] = NULL;
+  }
+  if (argv && !fchdir(fds[0]) && (output = fdopen(fds[1], "w")))
+    fds[1] = -1;
+  if (output && (errors = fdopen(fds[2], "w"))) fds[2] = -1;
+  if (errors) {
+    set_streams(output, errors);
+    status = grep(argc, argv, cache);
+    set_streams(NULL, NULL);
+  }
+  if (output) fclose(output);
+  if (errors) fclose(errors);
+  for (int i = 0; i < 3; i++)
+    if (fds[i] >= 0) close(fds[i]);
+  free(argv);
+  free(request);
+  if (write(client, &status, 1) < 0) status = 2;
+}
+
+// Each worker takes its own copy of the working directory first, so that
+// following a client into its directory moves no other worker.
+static void *worker(void *data) {
+  server *s = data;
+  int client;
+
+  if (unshare(CLONE_FS)) return NULL;
+  while ((client = accept4(s->fd, NULL, NULL, SOCK_CLOEXEC)) >= 0 ||
+         errno == EINTR || errno == ECONNABORTED) {
+    if (client < 0) continue;
+    serve_client(s->cache, client);
+    close(client);
+  }
+
+  return NULL;
+}
+
+static int socket_address(const char *path, struct sockaddr_un *address) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address->sun_path)) return 0;
+  strcpy(address->sun_path, path);
+
+  return 1;
+}
+
+int serve(const char *path, size_t memory) {
+  struct sockaddr_un address;
+  struct stat st;
+  daemon_cache cache = {.lock = PTHREAD_MUTEX_INITIALIZER,
+                        .file_limit = memory ? memory : S21_DAEMON_FILE_BYTES};
+  server s = {socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0), &cache};
+  pthread_t threads[S21_DAEMON_THREADS];
+  int started = 0, result = s.fd >= 0 && socket_address(path, &address);
+
+  // a client that goes away mid-search must not end the daemon
+  signal(SIGPIPE, SIG_IGN);
+  // a socket left by an earlier daemon is replaced, never another file
+  if (result && !lstat(path, &st) && S_ISSOCK(st.st_mode)) unlink(path);
+  if (result)
+    result = !bind(s.fd, (struct sockaddr *)&address, sizeof(address)) &&
+             !listen(s.fd, SOMAXCONN);
+  for (int t = 0; result && t < S21_DAEMON_THREADS; t++)
+    started += !pthread_create(&threads[started], NULL, worker, &s);
+  for (int t = 0; t < started; t++) pthread_join(threads[t], NULL);
+  // workers only return when they can't serve
+  if (!result || started)
+    fprintf(stderr, "grep: %s: cannot serve: %s\n", path, strerror(errno));
+  if (s.fd >= 0) close(s.fd);
+
+  return 2;
+}
+
+static int send_request(int fd, int argc, char *argv[]) {
+  int fds[3] = {open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC), STDOUT_FILENO,
+                STDERR_FILENO};
+  char control[CMSG_SPACE(sizeof(fds))] = {0}, *request, *p;
+  size_t len = sizeof("s21_grep");
+  struct iovec iov;
+  struct msghdr message = {.msg_iov = &iov, .msg_iovlen = 1,
+                           .msg_control = control, .msg_controllen = sizeof(control)};
+  struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+  ssize_t n = -1;
+
+  for (int i = 1; i < argc; i++) len += strlen(argv[i]) + 1;
+  if (fds[0] >= 0 && (request = p = malloc(len))) {
+    p = stpcpy(p, "s21_grep") + 1;
+    for (int i = 1; i < argc; i++) p = stpcpy(p, argv[i]) + 1;
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(header), fds, sizeof(fds));
+    iov = (struct iovec){request, len};
+    for (size_t done = 0; done < len && (n = sendmsg(fd, &message, 0)) > 0; done += n) {
+      iov = (struct iovec){request + done + n, len - done - n};
+      message.msg_control = NULL;
+      message.msg_controllen = 0;
+    }
+    free(request);
+  }
+  if (fds[0] >= 0) close(fds[0]);
+
+  return n > 0 && !shutdown(fd, SHUT_WR);
+}
+
+// Without a daemon to answer, the search runs in this process instead.
+int ask_server(const char *path, int argc, char *argv[]) {
+  struct sockaddr_un address;
+  unsigned char status = 2;
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  if (fd < 0 || !socket_address(path, &address) ||
+      connect(fd, (struct sockaddr *)&address, sizeof(address))) {
+    if (fd >= 0) close(fd);
+    return grep(argc, argv, NULL);
+  }
+  if (!send_request(fd, argc, argv) || read(fd, &status, 1) != 1) {
+    fprintf(stderr, "grep: %s: no answer from the daemon\n", path);
+    status = 2;
+  }
+  close(fd);
+
+  return status;
+}
@@ -0,0 +1,130 @@
+#include "s21_grep.h"
+
+#include <errno.h>
+#include <sys/inotify.h>
+
+// --follow: search what the files hold now, then sleep in read() on an
+// inotify descriptor and search only the bytes appended since. Files are
+// followed by name, so a rotated or recreated log is picked up again.
+
+typedef struct {
+  char *filename;
+  const char *basename;
+  int fd;
+  int wd;
+  int dir_wd;
+  s21g_search search;
+  s21g_stream stream;
+} followed_file;
+
+static void read_followed(followed_file *file, flags *options) {
+  struct stat st;
+  long long position = file->search.offset + file->stream.used;
+
+  if (file->fd >= 0 && !fstat(file->fd, &st) && st.st_size < position) {
+    if (!options->s) fprintf(error_stream(), "grep: %s: file truncated\n", file->filename);
+    lseek(file->fd, 0, SEEK_SET);
+    s21g_search_reset(&file->search, file->filename);
+    s21g_stream_reset(&file->stream);
+  }
+  if (file->fd >= 0) s21g_stream_read(&file->search, &file->stream, file->fd);
+}
+
+static void close_followed(followed_file *file, int inotify_fd) {
+  if (file->wd >= 0) inotify_rm_watch(inotify_fd, file->wd);
+  if (file->fd >= 0) close(file->fd);
+  file->fd = -1;
+  file->wd = -1;
+}
+
+// True when the name now refers to another file than the one being read.
+static int replaced(followed_file *file) {
+  struct stat by_name, by_fd;
+
+  return file->fd < 0 || stat(file->filename, &by_name) ||
+         fstat(file->fd, &by_fd) || by_name.st_ino != by_fd.st_ino ||
+         by_name.st_dev != by_fd.st_dev;
+}
+
+static void open_followed(followed_file *file, int inotify_fd, flags *options) {
+  if ((file->fd = open(file->filename, O_RDONLY)) >= 0) {
+    file->wd = inotify_add_watch(inotify_fd, file->filename,
+                                 IN_MODIFY | IN_DELETE_SELF);
+    s21g_search_reset(&file->search, file->filename);
+    s21g_stream_reset(&file->stream);
+    read_followed(file, options);
+  } else {
+    file_error(file->filename, errno, *options);
+  }
+}
+
+static int watch_directory(int inotify_fd, followed_file *file) {
+  char *slash = strrchr(file->filename, '/'), *directory;
+  int wd = -1;
+
+  file->basename = slash ? slash + 1 : file->filename;
+  if (!slash)
+    directory = strdup(".");
+  else
+    directory = strndup(file->filename, slash == file->filename ? 1 : slash - file->filename);
+  if (directory) wd = inotify_add_watch(inotify_fd, directory, IN_CREATE | IN_MOVED_TO);
+  free(directory);
+
+  return wd;
+}
+
+static void handle_event(followed_file *files, int count, int inotify_fd,
+                         const struct inotify_event *event, flags *options) {
+  for (int i = 0; i < count; i++) {
+    followed_file *file = &files[i];
+    if (file->fd >= 0 && event->wd == file->wd) {
+      read_followed(file, options);
+      if (event->mask & IN_DELETE_SELF) close_followed(file, inotify_fd);
+    } else if (event->wd == file->dir_wd && event->len &&
+               !strcmp(event->name, file->basename) && replaced(file)) {
+      // a rotated or deleted file is read until a new one takes its name
+      read_followed(file, options);
+      close_followed(file, inotify_fd);
+      open_followed(file, inotify_fd, options);
+    }
+  }
+}
+
+int follow_files(s21g_patterns *patterns, char **filenames, int count,
+                 int mode, flags options) {
+  char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  int inotify_fd = inotify_init1(IN_CLOEXEC), result = inotify_fd >= 0;
+  followed_file *files = calloc(count, sizeof(followed_file));
+  ssize_t n = 0;
+
+  if (!files) result = 0;
+  for (int i = 0; result && i < count; i++) {
+    files[i].filename = filenames[i];
+    files[i].fd = files[i].wd = -1;
+    s21g_search_init(&files[i].search, patterns, mode, line_callback(options),
+                     &options);
+    s21g_stream_init(&files[i].stream);
+    files[i].stream.max_line = options.max_line;
+    files[i].dir_wd = watch_directory(inotify_fd, &files[i]);
+    open_followed(&files[i], inotify_fd, &options);
+  }
+  fflush(output_stream());
+
+  while (result && ((n = read(inotify_fd, events, sizeof(events))) > 0 || errno == EINTR)) {
+    for (char *p = events; n > 0 && p < events + n;) {
+      const struct inotify_event *event = (const struct inotify_event *)p;
+      handle_event(files, count, inotify_fd, event, &options);
+      p += sizeof(struct inotify_event) + event->len;
+    }
+    fflush(output_stream());
+  }
+
+  for (int i = 0; files && i < count; i++) {
+    close_followed(&files[i], inotify_fd);
+    s21g_stream_free(&files[i].stream);
+  }
+  free(files);
+  if (inotify_fd >= 0) close(inotify_fd);
+
+  return !result;
+}
@@ -0,0 +1,391 @@
+#include "s21_grep.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+// Read-ahead stage for many files: up to window (at most S21_IO_WINDOW)
+// files are opened and read while earlier ones are being matched, with io_uring where the kernel
+// has it and a small thread pool otherwise. Files are still handed to the
+// matcher in argument order, so the output doesn't change. Only the first
+// slot of a file is read ahead; the matcher reads the rest from fd, which
+// is positioned after it.
+
+typedef struct {
+  int fd;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_ring, *cq_ring;
+  size_t sq_size, cq_size, sqes_size;
+  unsigned queued;
+} uring;
+
+typedef struct {
+  int fd;
+  char *buffer;
+  ssize_t len;
+  int error;
+  int done;
+} io_slot;
+
+struct file_reader {
+  char **filenames;
+  int count;
+  int next_submit;  // next file to start reading
+  int next_out;     // next file to hand to the matcher
+  int window;       // slots in use; reads wait for one to be released
+  io_slot slots[S21_IO_WINDOW];
+  int backend;
+  uring ring;
+  pthread_t threads[S21_IO_THREAD_COUNT];
+  int started;
+  int stop;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+#define OP_OPEN 0
+#define OP_READ 1
+
+static int uring_setup(uring *ring, unsigned entries) {
+  struct io_uring_params params;
+  int result = 1;
+
+  memset(&params, 0, sizeof(params));
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (ring->fd < 0) return 0;
+
+  ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sq_ring = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  ring->cq_ring = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED ||
+      ring->sqes == MAP_FAILED)
+    result = 0;
+
+  if (result) {
+    char *sq = ring->sq_ring, *cq = ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+  }
+
+  return result;
+}
+
+static void uring_close(uring *ring) {
+  if (ring->sq_ring && ring->sq_ring != MAP_FAILED) munmap(ring->sq_ring, ring->sq_size);
+  if (ring->cq_ring && ring->cq_ring != MAP_FAILED) munmap(ring->cq_ring, ring->cq_size);
+  if (ring->sqes && ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+  if (ring->fd >= 0) close(ring->fd);
+  ring->fd = -1;
+}
+
+// The kernel must know OPENAT and READ (5.6+), otherwise use the threads.
+static int uring_supported(uring *ring) {
+  size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe *probe = calloc(1, size);
+  int result = probe && !syscall(__NR_io_uring_register, ring->fd,
+                                 IORING_REGISTER_PROBE, probe, 256);
+
+  if (result)
+    result = probe->last_op >= IORING_OP_READ &&
+             (probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED) &&
+             (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+  free(probe);
+
+  return result;
+}
+
+static struct io_uring_sqe *uring_sqe(uring *ring) {
+  unsigned tail = *ring->sq_tail + ring->queued, index = tail & *ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[index];
+
+  memset(sqe, 0, sizeof(*sqe));
+  ring->sq_array[index] = index;
+  ring->queued++;
+
+  return sqe;
+}
+
+// Submits what is queued and, with wait, blocks for one completion.
+static int uring_enter(uring *ring, int wait) {
+  unsigned submit = ring->queued;
+
+  __atomic_store_n(ring->sq_tail, *ring->sq_tail + submit, __ATOMIC_RELEASE);
+  ring->queued = 0;
+
+  return (!submit && !wait) ||
+         syscall(__NR_io_uring_enter, ring->fd, submit, wait,
+                 wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0) >= 0 ||
+         errno == EINTR;
+}
+
+static void submit_open(file_reader *reader, int i) {
+  struct io_uring_sqe *sqe = uring_sqe(&reader->ring);
+
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = (unsigned long)reader->filenames[i];
+  sqe->open_flags = O_RDONLY;
+  sqe->user_data = (unsigned long long)i << 1 | OP_OPEN;
+}
+
+static void submit_read(file_reader *reader, int i) {
+  struct io_uring_sqe *sqe = uring_sqe(&reader->ring);
+  io_slot *slot = &reader->slots[i % reader->window];
+
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = slot->fd;
+  sqe->off = 0;
+  sqe->addr = (unsigned long)slot->buffer;
+  sqe->len = S21_IO_SLOT_SIZE;
+  sqe->user_data = (unsigned long long)i << 1 | OP_READ;
+}
+
+static void uring_complete(file_reader *reader) {
+  unsigned head = *reader->ring.cq_head;
+  unsigned tail = __atomic_load_n(reader->ring.cq_tail, __ATOMIC_ACQUIRE);
+
+  for (; head != tail; head++) {
+    struct io_uring_cqe *cqe = &reader->ring.cqes[head & *reader->ring.cq_mask];
+    int i = cqe->user_data >> 1;
+    io_slot *slot = &reader->slots[i % reader->window];
+    struct stat st;
+    if (cqe->res < 0) {
+      slot->error = -cqe->res;
+      slot->done = 1;
+    } else if ((cqe->user_data & 1) == OP_OPEN) {
+      slot->fd = cqe->res;
+      // a pipe or FIFO has no offset to read at: the matcher reads it all
+      if (!fstat(slot->fd, &st) && S_ISREG(st.st_mode))
+        submit_read(reader, i);
+      else
+        slot->done = 1;
+    } else {
+      // the read was at offset 0 and left the file position alone
+      slot->len = cqe->res;
+      if (lseek(slot->fd, slot->len, SEEK_SET) < 0) slot->error = errno;
+      slot->done = 1;
+    }
+  }
+  __atomic_store_n(reader->ring.cq_head, head, __ATOMIC_RELEASE);
+}
+
+static void read_slot(file_reader *reader, int i) {
+  io_slot *slot = &reader->slots[i % reader->window];
+
+  if ((slot->fd = open(reader->filenames[i], O_RDONLY)) < 0)
+    slot->error = errno;
+  else if ((slot->len = read(slot->fd, slot->buffer, S21_IO_SLOT_SIZE)) < 0)
+    slot->error = errno;
+}
+
+static void *reader_thread(void *arg) {
+  file_reader *reader = arg;
+
+  pthread_mutex_lock(&reader->lock);
+  while (!reader->stop) {
+    int i = reader->next_submit;
+    if (i < reader->count && i < reader->next_out + reader->window) {
+      reader->next_submit++;
+      pthread_mutex_unlock(&reader->lock);
+      read_slot(reader, i);
+      pthread_mutex_lock(&reader->lock);
+      reader->slots[i % reader->window].done = 1;
+      pthread_cond_broadcast(&reader->cond);
+    } else {
+      pthread_cond_wait(&reader->cond, &reader->lock);
+    }
+  }
+  pthread_mutex_unlock(&reader->lock);
+
+  return NULL;
+}
+
+// Queues opens for every file that fits in the window.
+static void uring_fill(file_reader *reader) {
+  while (reader->next_submit < reader->count &&
+         reader->next_submit < reader->next_out + reader->window)
+    submit_open(reader, reader->next_submit++);
+}
+
+file_reader *reader_start(char **filenames, int count, int backend,
+                          int window) {
+  file_reader *reader = calloc(1, sizeof(file_reader));
+  int result = reader != NULL;
+
+  if (result) reader->window = window < S21_IO_WINDOW ? window : S21_IO_WINDOW;
+  for (int i = 0; result && i < reader->window; i++) {
+    reader->slots[i].fd = -1;
+    // a NUL past the data, as in the library's stream buffers
+    result = (reader->slots[i].buffer = malloc(S21_IO_SLOT_SIZE + 1)) != NULL;
+    if (result) reader->slots[i].buffer[S21_IO_SLOT_SIZE] = '\0';
+  }
+  if (result) {
+    reader->filenames = filenames;
+    reader->count = count;
+    reader->ring.fd = -1;
+    if (backend != S21_IO_THREADS && uring_setup(&reader->ring, S21_IO_WINDOW) &&
+        uring_supported(&reader->ring)) {
+      reader->backend = S21_IO_URING;
+      uring_fill(reader);
+    } else {
+      uring_close(&reader->ring);
+      reader->backend = S21_IO_THREADS;
+      pthread_mutex_init(&reader->lock, NULL);
+      pthread_cond_init(&reader->cond, NULL);
+      for (int t = 0; t < S21_IO_THREAD_COUNT; t++)
+        if (!pthread_create(&reader->threads[t], NULL, reader_thread, reader))
+          reader->started++;
+      result = reader->started > 0;
+    }
+  }
+  if (!result) reader_stop(reader);
+
+  return result ? reader : NULL;
+}
+
+// Waits for the next file in argument order: 1, or 0 after the last one,
+// or -1 when io_uring fails and the files from this one on are left to the
+// caller. The slot stays valid until reader_release; what follows
+// data[0, len) is read from fd. error is the errno of a failed open (fd is
+// then -1) or read. A file the read-ahead couldn't open for lack of
+// descriptors is opened again here, in its turn.
+int reader_next(file_reader *reader, const char **filename, int *fd,
+                const char **data, ssize_t *len, int *error) {
+  int result = reader->next_out < reader->count;
+  io_slot *slot = &reader->slots[reader->next_out % reader->window];
+
+  if (result && reader->backend == S21_IO_URING) {
+    while (result > 0 && !slot->done) {
+      if (uring_enter(&reader->ring, 1))
+        uring_complete(reader);
+      else
+        result = -1;
+    }
+    // reads queued by finished opens start while this file is matched
+    if (result > 0) uring_enter(&reader->ring, 0);
+  } else if (result) {
+    pthread_mutex_lock(&reader->lock);
+    while (!slot->done) pthread_cond_wait(&reader->cond, &reader->lock);
+    pthread_mutex_unlock(&reader->lock);
+  }
+
+  if (result > 0 && slot->fd < 0 && (slot->error == EMFILE || slot->error == ENFILE)) {
+    slot->error = 0;
+    if ((slot->fd = open(reader->filenames[reader->next_out], O_RDONLY)) < 0)
+      slot->error = errno;
+  }
+  if (result > 0) {
+    *filename = reader->filenames[reader->next_out];
+    *fd = slot->fd;
+    *data = slot->buffer;
+    *len = slot->error ? 0 : slot->len;
+    *error = slot->error;
+  }
+
+  return result;
+}
+
+void reader_release(file_reader *reader) {
+  io_slot *slot = &reader->slots[reader->next_out % reader->window];
+
+  if (reader->backend != S21_IO_URING) pthread_mutex_lock(&reader->lock);
+  if (reader->next_submit - reader->next_out > stats.window_peak)
+    stats.window_peak = reader->next_submit - reader->next_out;
+  if (slot->fd >= 0) close(slot->fd);
+  slot->fd = -1;
+  slot->len = slot->error = slot->done = 0;
+  reader->next_out++;
+  if (reader->backend == S21_IO_URING) {
+    uring_fill(reader);
+    uring_enter(&reader->ring, 0);
+  } else {
+    pthread_cond_broadcast(&reader->cond);
+    pthread_mutex_unlock(&reader->lock);
+  }
+}
+
+// Searches files in order through the read-ahead and returns how many, from
+// the first, it got to; 0 when the read-ahead doesn't start.
+int search_files(s21g_patterns *patterns, char **filenames, int count,
+                 flags options) {
+  file_reader *reader = reader_start(filenames, count, options.io,
+                                     options.window);
+  s21g_search search;
+  s21g_stream stream;
+  const char *filename, *data;
+  int fd, error, searched = 0;
+  ssize_t len;
+
+  s21g_search_init(&search, patterns, search_mode(options),
+                   line_callback(options), &options);
+  search_counts(&search, options);
+  s21g_stream_init(&stream);
+  stream.max_line = options.max_line;
+  while (reader && reader_next(reader, &filename, &fd, &data, &len, &error) > 0) {
+    if (fd < 0) {
+      file_error(filename, error, options);
+    } else {
+      s21g_search_reset(&search, filename);
+      s21g_stream_reset(&stream);
+      long selected = error ? -1 : s21g_stream_feed(&search, &stream, data, len);
+      // a short first read is not the end of a pipe or a growing file
+      if (selected >= 0 && !search.stopped) selected = s21g_stream_read(&search, &stream, fd);
+      if (selected >= 0) selected = s21g_stream_finish(&search, &stream);
+      if (selected < 0 && !error) error = search.error;
+      if (error) file_error(filename, error, options);
+      print_totals(filename, selected < 0 ? 0 : selected, options);
+      if (selected > 0) stats.selected += selected;
+    }
+    reader_release(reader);
+    searched++;
+  }
+  note_stream(&stream);
+  s21g_stream_free(&stream);
+  if (reader) reader_stop(reader);
+
+  return searched;
+}
+
+void reader_stop(file_reader *reader) {
+  if (reader && reader->started) {
+    pthread_mutex_lock(&reader->lock);
+    reader->stop = 1;
+    pthread_cond_broadcast(&reader->cond);
+    pthread_mutex_unlock(&reader->lock);
+    for (int t = 0; t < reader->started; t++) pthread_join(reader->threads[t], NULL);
+  }
+  if (reader && reader->backend == S21_IO_URING) {
+    // let the kernel finish what is in flight before the buffers go away
+    reader->count = reader->next_submit;
+    while (reader->next_out < reader->next_submit) {
+      const char *filename, *data;
+      int fd, error;
+      ssize_t len;
+      if (reader_next(reader, &filename, &fd, &data, &len, &error) < 0) break;
+      reader_release(reader);
+    }
+    uring_close(&reader->ring);
+  }
+  for (int i = 0; reader && i < reader->window; i++) {
+    if (reader->slots[i].fd >= 0) close(reader->slots[i].fd);
+    free(reader->slots[i].buffer);
+  }
+  free(reader);
+}
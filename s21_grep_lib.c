@@ -0,0 +1,1171 @@
+#define _GNU_SOURCE
+
+#include "s21_grep_lib.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <locale.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <wchar.h>
+#include <wctype.h>
+
+#include "s21_simd.h"
+
+#ifdef HAVE_PCRE2
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#endif
+
+typedef struct {
+  regex_t *templates;
+  void **perl;  // pcre2_code per pattern instead, with S21G_PERL
+  regex_t **ascii;
+  char **sources;
+  int from;
+  int to;
+  int cflags;
+  int flags;
+  int result;  // a regcomp or a pcre2_compile error code
+  int compiled;  // templates[from, from + compiled) are valid
+} compile_job;
+
+// A pcre2_match error (or ENOMEM) since the current search started; the
+// search fails with it instead of taking the line for one without a match.
+static __thread int match_error;
+
+#ifdef HAVE_PCRE2
+// One span per match is all a search asks for. The match data is per
+// thread and reused for every line, so compiled patterns stay shareable;
+// it is freed when the thread exits, or by s21g_free for the calling one.
+static __thread pcre2_match_data *match_data;
+static pthread_key_t match_data_key;
+static pthread_once_t match_data_once = PTHREAD_ONCE_INIT;
+
+static void free_match_data(void *data) { pcre2_match_data_free(data); }
+
+static void create_match_data_key(void) {
+  pthread_key_create(&match_data_key, free_match_data);
+}
+
+// -w and -x are written into the pattern the way GNU grep -P does it, so
+// the matcher backtracks into a span that satisfies them. The subject is
+// always a single line, so ^, $, \A and \z all mean its ends.
+static int compile_perl(compile_job *job, int i) {
+  const char *prefix = "", *suffix = "", *source = job->sources[i];
+  uint32_t options = 0;
+  size_t len = strlen(source) + 24;
+  char *wrapped = malloc(len);
+  PCRE2_SIZE offset;
+  int error = PCRE2_ERROR_NOMEMORY;
+  pcre2_code *code = NULL;
+
+  if (job->flags & S21G_ICASE) options |= PCRE2_CASELESS;
+  if (job->flags & S21G_LINE) {
+    prefix = "^(?:";
+    suffix = ")$";
+  } else if (job->flags & S21G_WORD) {
+    prefix = "(?<!\\w)(?:";
+    suffix = ")(?!\\w)";
+  }
+  if (wrapped) {
+    snprintf(wrapped, len, "%s%s%s", prefix, source, suffix);
+    code = pcre2_compile((PCRE2_SPTR)wrapped, PCRE2_ZERO_TERMINATED, options, &error,
+                         &offset, NULL);
+    free(wrapped);
+  }
+  // without JIT support pcre2_match falls back to the interpreter
+  if (code) pcre2_jit_compile(code, PCRE2_JIT_COMPLETE);
+  job->perl[i] = code;
+
+  return code ? 0 : error;
+}
+
+static int perl_exec(const pcre2_code *code, const char *subject, regmatch_t *m,
+                     int eflags) {
+  uint32_t options = (eflags & REG_NOTBOL ? PCRE2_NOTBOL : 0) |
+                     (eflags & REG_NOTEOL ? PCRE2_NOTEOL : 0);
+  PCRE2_SIZE *ovector;
+  int result;
+
+  if (!match_data) {
+    pthread_once(&match_data_once, create_match_data_key);
+    if (!(match_data = pcre2_match_data_create(1, NULL))) {
+      match_error = ENOMEM;
+      return REG_ESPACE;
+    }
+    pthread_setspecific(match_data_key, match_data);
+  }
+  result = pcre2_match(code, (PCRE2_SPTR)subject, m->rm_eo, m->rm_so, options,
+                       match_data, NULL);
+  if (result < 0 && result != PCRE2_ERROR_NOMATCH && !match_error) match_error = result;
+  if (result < 0) return REG_NOMATCH;
+  ovector = pcre2_get_ovector_pointer(match_data);
+  // \K can set the start past the end
+  m->rm_so = ovector[0] < ovector[1] ? ovector[0] : ovector[1];
+  m->rm_eo = ovector[1];
+
+  return 0;
+}
+#endif
+
+// The single-byte twin of a pattern with only ASCII in it; on ASCII text
+// it matches what the multibyte compile matches. A pattern that fails here
+// is simply left to the multibyte compile.
+static regex_t *compile_ascii(const char *source, int cflags, locale_t c) {
+  regex_t *ascii = NULL;
+  locale_t caller;
+
+  if (c && s21_ascii_prefix(source, strlen(source)) == strlen(source) &&
+      (ascii = malloc(sizeof(regex_t)))) {
+    caller = uselocale(c);
+    if (regcomp(ascii, source, cflags)) {
+      free(ascii);
+      ascii = NULL;
+    }
+    uselocale(caller);
+  }
+
+  return ascii;
+}
+
+static void *compile_range(void *arg) {
+  compile_job *job = arg;
+  locale_t c = job->ascii ? newlocale(LC_ALL_MASK, "C", (locale_t)0) : (locale_t)0;
+
+  for (int i = job->from; !job->result && i < job->to; i++) {
+#ifdef HAVE_PCRE2
+    if (job->perl)
+      job->result = compile_perl(job, i);
+    else
+#endif
+      job->result = regcomp(&job->templates[i], job->sources[i], job->cflags);
+    if (!job->result && job->ascii)
+      job->ascii[i] = compile_ascii(job->sources[i], job->cflags, c);
+    if (!job->result) job->compiled++;
+  }
+  if (c) freelocale(c);
+
+  return NULL;
+}
+
+// In a UTF-8 locale regexec decodes every character, even of ASCII text.
+// Whole lines of ASCII are searched with the single-byte twin instead and
+// only lines with other bytes in them go through the multibyte compile.
+// Where the ASCII runs between such lines are shorter than S21G_ASCII_RUN,
+// a call per run costs more than decoding it, and the rest of the span goes
+// to the multibyte compile at once. A match never spans lines, so the first
+// match found this way is still the leftmost-longest one. The span is
+// checked for ASCII a window at a time, so finding a match near its start
+// does not scan all of it.
+static int utf8_exec(const s21g_patterns *patterns, int i, const char *subject,
+                     regmatch_t *m, int eflags) {
+  size_t so = m->rm_so, eo = m->rm_eo, limit, ascii, ls, le;
+  int result = REG_NOMATCH, window;
+  const char *nl = NULL;
+
+  while (result == REG_NOMATCH && so <= eo) {
+    limit = eo - so > S21G_ASCII_WINDOW ? so + S21G_ASCII_WINDOW : eo;
+    ascii = so + s21_ascii_prefix(subject + so, limit - so);
+    window = ascii == limit && limit < eo &&
+             (nl = memrchr(subject + so, '\n', limit - so));
+    // a line longer than the window: its end is found the long way
+    if (ascii == limit && limit < eo && !window)
+      ascii = limit + s21_ascii_prefix(subject + limit, eo - limit);
+    if (ascii == eo) {
+      m->rm_so = so;
+      m->rm_eo = eo;
+      return regexec(patterns->ascii[i], subject, 1, m, REG_STARTEND | eflags);
+    }
+    // the ASCII lines: a window's up to its last newline, else those
+    // before the line with the non-ASCII byte
+    if (!window) nl = memrchr(subject + so, '\n', ascii - so);
+    ls = nl ? (size_t)(nl - subject) + 1 : so;
+    if (window || ls - so >= S21G_ASCII_RUN) {
+      m->rm_so = so;
+      m->rm_eo = ls - 1;
+      result = regexec(patterns->ascii[i], subject, 1, m,
+                       REG_STARTEND | (eflags & REG_NOTBOL));
+      eflags &= ~REG_NOTBOL;
+      so = ls;
+      if (window) continue;
+    }
+    if (result == REG_NOMATCH) {
+      nl = memchr(subject + ascii, '\n', eo - ascii);
+      le = nl ? (size_t)(nl - subject) : eo;
+      // with a short ASCII run after the line, the rest of the span too
+      if (le < eo) {
+        limit = eo - le - 1 > S21G_ASCII_RUN ? S21G_ASCII_RUN : eo - le - 1;
+        if (s21_ascii_prefix(subject + le + 1, limit) < S21G_ASCII_RUN) le = eo;
+      }
+      m->rm_so = so;
+      m->rm_eo = le;
+      result = regexec(&patterns->templates[i], subject, 1, m,
+                       REG_STARTEND | (eflags & REG_NOTBOL) |
+                           (le == eo ? eflags & REG_NOTEOL : 0));
+      so = le + 1;
+      eflags &= ~REG_NOTBOL;
+    }
+  }
+
+  return result;
+}
+
+// regexec with REG_STARTEND: m holds the span to search and gets the match.
+// A literal's leftmost-longest match is its first occurrence, which memmem
+// finds many times faster.
+static int pattern_exec(const s21g_patterns *patterns, int i, const char *subject,
+                        regmatch_t *m, int eflags) {
+  const char *literal = patterns->literals ? patterns->literals[i] : NULL;
+
+  if (literal) {
+    size_t len = patterns->literal_lens[i];
+    const char *hit = memmem(subject + m->rm_so, m->rm_eo - m->rm_so, literal, len);
+    if (!hit) return REG_NOMATCH;
+    m->rm_so = hit - subject;
+    m->rm_eo = m->rm_so + len;
+    return 0;
+  }
+#ifdef HAVE_PCRE2
+  if (patterns->perl) return perl_exec(patterns->perl[i], subject, m, eflags);
+#endif
+  if (patterns->ascii && patterns->ascii[i])
+    return utf8_exec(patterns, i, subject, m, eflags);
+  return regexec(&patterns->templates[i], subject, 1, m, REG_STARTEND | eflags);
+}
+
+// pattern_exec over a block of lines. PCRE2 gets one line at a time as
+// its subject, as GNU grep -P does: over the block \A, \z, \G and
+// lookarounds would see the block's ends and the lines next to a match.
+static int block_exec(const s21g_patterns *patterns, int i, const char *buffer,
+                      regmatch_t *m) {
+  size_t pos = m->rm_so, len = m->rm_eo;
+
+  if (!patterns->perl) return pattern_exec(patterns, i, buffer, m, 0);
+  while (pos < len && !match_error) {
+    const char *nl = s21_find_newline(buffer + pos, len - pos);
+    size_t le = nl ? (size_t)(nl - buffer) : len;
+    regmatch_t line = {0, le - pos};
+    if (!pattern_exec(patterns, i, buffer + pos, &line, 0)) {
+      m->rm_so = pos + line.rm_so;
+      m->rm_eo = pos + line.rm_eo;
+      return 0;
+    }
+    pos = le + 1;
+  }
+
+  return REG_NOMATCH;
+}
+
+static void free_pattern(s21g_patterns *patterns, int i) {
+#ifdef HAVE_PCRE2
+  if (patterns->perl) {
+    pcre2_code_free(patterns->perl[i]);
+    return;
+  }
+#endif
+  regfree(&patterns->templates[i]);
+  if (patterns->ascii && patterns->ascii[i]) {
+    regfree(patterns->ascii[i]);
+    free(patterns->ascii[i]);
+    patterns->ascii[i] = NULL;
+  }
+}
+
+static void describe_error(const compile_job *job, char *error, size_t error_size) {
+  if (job->perl) {
+#ifdef HAVE_PCRE2
+    pcre2_get_error_message(job->result, (PCRE2_UCHAR *)error, error_size);
+#endif
+  } else {
+    regerror(job->result, &job->templates[job->from + job->compiled], error, error_size);
+  }
+}
+
+// Copies of the ERE patterns that are plain non-empty strings, with their
+// lengths; -i and -P keep every pattern on its engine.
+static void find_literals(s21g_patterns *patterns, char **sources, int count, int flags) {
+  if ((flags & (S21G_ICASE | S21G_PERL)) || !count) return;
+  patterns->literals = calloc(count, sizeof(char *));
+  patterns->literal_lens = calloc(count, sizeof(size_t));
+  if (!patterns->literals || !patterns->literal_lens) {
+    free(patterns->literals);
+    free(patterns->literal_lens);
+    patterns->literals = NULL;
+    patterns->literal_lens = NULL;
+  }
+  for (int i = 0; patterns->literals && i < count; i++)
+    if (*sources[i] && !strpbrk(sources[i], "\\^$.[]|()*+?{}")) {
+      patterns->literals[i] = strdup(sources[i]);
+      if (patterns->literals[i]) patterns->literal_lens[i] = strlen(sources[i]);
+    }
+}
+
+// Whether an ERE has ^ or $ (or GNU's \` and \') outside bracket
+// expressions.
+static int has_anchor(const char *source) {
+  for (size_t i = 0; source[i]; i++) {
+    if (source[i] == '\\' && source[i + 1]) {
+      if (strchr("`'", source[++i])) return 1;
+    } else if (source[i] == '^' || source[i] == '$') {
+      return 1;
+    } else if (source[i] == '[') {
+      i += source[i + 1] == '^' ? 2 : 1;
+      if (source[i] == ']') i++;
+      while (source[i] && source[i] != ']') {
+        // [:class:], [=equivalence=] and [.collating.] may hold a ]
+        if (source[i] == '[' && source[i + 1] && strchr(":=.", source[i + 1])) {
+          char close = source[i + 1];
+          for (i += 2; source[i] && !(source[i] == close && source[i + 1] == ']'); i++) continue;
+          if (source[i]) i++;
+        }
+        if (source[i]) i++;
+      }
+      if (!source[i]) break;
+    }
+  }
+
+  return 0;
+}
+
+// Whether every match of an ERE fits well inside S21G_WINDOW_OVERLAP:
+// without repetition or back-references each byte of the source matches
+// at most one character. A window then holds any match whole, with the
+// context on both sides that -w needs.
+static int short_matches(const char *source) {
+  for (size_t i = 0; source[i]; i++)
+    if (strchr("*+{", source[i]) || (source[i] == '\\' && isdigit((unsigned char)source[i + 1])))
+      return 0;
+
+  return strlen(source) * MB_CUR_MAX < S21G_WINDOW_OVERLAP / 2;
+}
+
+static int compile_threads(int count) {
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (threads > count / S21G_PATTERNS_PER_THREAD)
+    threads = count / S21G_PATTERNS_PER_THREAD;
+  if (threads > S21G_MAX_THREADS) threads = S21G_MAX_THREADS;
+
+  return threads < 1 ? 1 : threads;
+}
+
+// Large pattern sets are compiled by several threads, each taking a
+// contiguous range; neither regcomp nor pcre2_compile keeps shared state.
+int s21g_compile(s21g_patterns *patterns, char **sources, int count,
+                 int flags, char *error, size_t error_size) {
+  int result = 0, threads = compile_threads(count), anchored = (flags & S21G_LINE) != 0;
+  int running[S21G_MAX_THREADS] = {0};
+  int cflags = REG_EXTENDED | REG_NEWLINE;
+  compile_job jobs[S21G_MAX_THREADS];
+  pthread_t ids[S21G_MAX_THREADS];
+
+  if (flags & S21G_ICASE) cflags |= REG_ICASE;
+  patterns->count = 0;
+  patterns->flags = flags;
+  patterns->templates = NULL;
+  patterns->perl = NULL;
+  patterns->literals = NULL;
+  patterns->literal_lens = NULL;
+  patterns->ascii = NULL;
+  patterns->whole_lines = 0;
+#ifndef HAVE_PCRE2
+  if (flags & S21G_PERL) {
+    if (error) snprintf(error, error_size, "Perl matching not supported in a build without PCRE2");
+    return REG_BADPAT;
+  }
+#endif
+  if (flags & S21G_PERL)
+    patterns->perl = malloc((count ? count : 1) * sizeof(void *));
+  else
+    patterns->templates = malloc((count ? count : 1) * sizeof(regex_t));
+  if (!patterns->templates && !patterns->perl) result = REG_ESPACE;
+  // without the twins every line goes through the multibyte compile
+  if (patterns->templates && (flags & S21G_UTF8))
+    patterns->ascii = calloc(count ? count : 1, sizeof(regex_t *));
+
+  for (int t = 0; !result && t < threads; t++) {
+    jobs[t] = (compile_job){patterns->templates, patterns->perl, patterns->ascii, sources,
+                            (long)count * t / threads, (long)count * (t + 1) / threads,
+                            cflags, flags, 0, 0};
+    if (t > 0) running[t] = !pthread_create(&ids[t], NULL, compile_range, &jobs[t]);
+  }
+  // the calling thread takes range 0 and any range a thread failed to start
+  for (int t = 0; !result && t < threads; t++)
+    if (!running[t]) compile_range(&jobs[t]);
+  for (int t = 1; !result && t < threads; t++)
+    if (running[t]) pthread_join(ids[t], NULL);
+
+  for (int t = 0; !result && t < threads; t++) {
+    patterns->count += jobs[t].compiled;
+    if (jobs[t].result) {
+      result = jobs[t].result;
+      if (error) describe_error(&jobs[t], error, error_size);
+    }
+  }
+
+  // without a copy a pattern simply stays with regexec
+  if (!result) find_literals(patterns, sources, count, flags);
+  // windows keep ^ and $ to the line's ends, but a match longer than the
+  // overlap can't be anchored to both; -P may look anywhere on the line
+  for (int i = 0; !result && i < count; i++)
+    if (has_anchor(sources[i])) anchored = 1;
+  for (int i = 0; !result && anchored && i < count; i++)
+    if (!short_matches(sources[i])) patterns->whole_lines = 1;
+  if (flags & S21G_PERL) patterns->whole_lines = 1;
+  if (result && (patterns->templates || patterns->perl)) {
+    for (int t = 0; t < threads; t++)
+      for (int i = 0; i < jobs[t].compiled; i++) free_pattern(patterns, jobs[t].from + i);
+    patterns->count = 0;
+    s21g_free(patterns);
+  }
+
+  return result;
+}
+
+void s21g_free(s21g_patterns *patterns) {
+  for (int i = 0; i < patterns->count; i++) {
+    free_pattern(patterns, i);
+    if (patterns->literals) free(patterns->literals[i]);
+  }
+  free(patterns->templates);
+  free(patterns->perl);
+  free(patterns->literals);
+  free(patterns->literal_lens);
+#ifdef HAVE_PCRE2
+  if (match_data) {
+    pthread_setspecific(match_data_key, NULL);
+    pcre2_match_data_free(match_data);
+    match_data = NULL;
+  }
+#endif
+  free(patterns->ascii);
+  patterns->templates = NULL;
+  patterns->perl = NULL;
+  patterns->literals = NULL;
+  patterns->literal_lens = NULL;
+  patterns->ascii = NULL;
+  patterns->count = 0;
+}
+
+void s21g_search_init(s21g_search *search, const s21g_patterns *patterns,
+                      int mode, s21g_callback callback, void *data) {
+  search->patterns = patterns;
+  search->mode = mode;
+  search->callback = callback;
+  search->data = data;
+  search->counts = NULL;
+  s21g_search_reset(search, NULL);
+}
+
+void s21g_search_reset(s21g_search *search, const char *filename) {
+  search->filename = filename;
+  search->line_number = 0;
+  search->offset = 0;
+  search->selected = 0;
+  search->stopped = 0;
+  search->error = 0;
+  if (search->counts) memset(search->counts, 0, search->patterns->count * sizeof(long));
+}
+
+// Stops a search that can't go on: the caller gets -1 and search->error.
+static long search_failed(s21g_search *search, int error) {
+  search->stopped = 1;
+  search->selected = -1;
+  if (!search->error) search->error = error;
+
+  return -1;
+}
+
+const char *s21g_strerror(int error) {
+#ifdef HAVE_PCRE2
+  static __thread char message[128];
+
+  if (error < 0 && pcre2_get_error_message(error, (PCRE2_UCHAR *)message, sizeof(message)) > 0)
+    return message;
+#endif
+  return strerror(error);
+}
+
+static int is_word_char(char c) { return isalnum((unsigned char)c) || c == '_'; }
+
+// With S21G_UTF8 a character around a -w match may take several bytes:
+// text[0, len) is decoded when it is exactly one valid character.
+static int is_word_utf8(const char *text, size_t len) {
+  mbstate_t state = {0};
+  wchar_t wc;
+
+  return s21_utf8_length((const unsigned char *)text, len) == len &&
+         mbrtowc(&wc, text, len, &state) == len && iswalnum(wc);
+}
+
+static int word_before(const s21g_patterns *patterns, const char *line, size_t so) {
+  size_t start = so - 1;
+
+  if (!(patterns->flags & S21G_UTF8) || !(line[start] & 0x80))
+    return is_word_char(line[start]);
+  while (start > 0 && so - start < 4 && (line[start] & 0xc0) == 0x80) start--;
+
+  return is_word_utf8(line + start, so - start);
+}
+
+static int word_after(const s21g_patterns *patterns, const char *line, size_t len,
+                      size_t eo) {
+  size_t n;
+
+  if (!(patterns->flags & S21G_UTF8) || !(line[eo] & 0x80))
+    return is_word_char(line[eo]);
+  n = s21_utf8_length((const unsigned char *)line + eo, len - eo);
+
+  return n && is_word_utf8(line + eo, n);
+}
+
+// Where a search retries after a match at so fails -w: the next character.
+static size_t next_start(const s21g_patterns *patterns, const char *line,
+                         size_t len, size_t so) {
+  size_t n = 0;
+
+  if ((patterns->flags & S21G_UTF8) && so < len && (line[so] & 0x80))
+    n = s21_utf8_length((const unsigned char *)line + so, len - so);
+
+  return so + (n ? n : 1);
+}
+
+// A match whose end fails -w may have a shorter one at the same start that
+// passes, as "foo|foo bar" has in "foo barx": like GNU grep, those are
+// tried before the next start. Ends step back a character at a time and
+// $ can't match before the end of the line.
+static int shorter_word_match(const s21g_patterns *patterns, int i, const char *line,
+                              size_t len, int eflags, regmatch_t *m) {
+  size_t so = m->rm_so, end = m->rm_eo;
+
+  while (end > so) {
+    end--;
+    while ((patterns->flags & S21G_UTF8) && end > so && (line[end] & 0xc0) == 0x80) end--;
+    m->rm_so = so;
+    m->rm_eo = end;
+    if (pattern_exec(patterns, i, line, m, eflags | REG_NOTEOL) || (size_t)m->rm_so != so)
+      return 0;
+    end = m->rm_eo;
+    if (end == len || !word_after(patterns, line, len, end)) return 1;
+  }
+
+  return 0;
+}
+
+// -w/-x are checked on the span regexec returns: a failed check costs a
+// couple of byte comparisons and the search retries from the next start.
+// eflags carries REG_NOTBOL/REG_NOTEOL for windows of a long line, which
+// never hold a whole line for -x.
+static int line_match(const s21g_patterns *patterns, int i, const char *line,
+                      size_t len, size_t from, int eflags, regmatch_t *m) {
+  int found = 0;
+
+  if ((patterns->flags & S21G_LINE) && (eflags & (REG_NOTBOL | REG_NOTEOL))) return 0;
+
+  while (!found && from <= len) {
+    m->rm_so = from;
+    m->rm_eo = len;
+    if (pattern_exec(patterns, i, line, m, eflags)) break;
+    size_t so = m->rm_so, eo = m->rm_eo;
+    found = 1;
+    // leftmost-longest: a failed -x at column 0 can't succeed later
+    if ((patterns->flags & S21G_LINE) && (so != 0 || eo != len)) {
+      found = 0;
+      from = len + 1;
+    } else if ((patterns->flags & S21G_WORD) &&
+               ((so > 0 && word_before(patterns, line, so)) ||
+                (eo < len && word_after(patterns, line, len, eo) &&
+                 !shorter_word_match(patterns, i, line, len, eflags, m)))) {
+      found = 0;
+      from = next_start(patterns, line, len, so);
+    }
+  }
+
+  return found;
+}
+
+// Leftmost (then longest) match of any pattern in line[from, len). With a
+// cache (rm_so -2 for unknown), each pattern's match is kept until from
+// passes it, and a pattern without a match is not searched again: -o then
+// scans a line once per pattern, not once per pattern and match.
+static int first_line_match(const s21g_patterns *patterns, const char *line,
+                            size_t len, size_t from, int eflags,
+                            regmatch_t *best, regmatch_t *cache) {
+  int best_i = -1, found;
+  regmatch_t m;
+
+  for (int i = 0; i < patterns->count; i++) {
+    if (cache && (cache[i].rm_so == -1 || (cache[i].rm_so >= 0 && (size_t)cache[i].rm_so >= from))) {
+      m = cache[i];
+      found = m.rm_so >= 0;
+    } else {
+      found = line_match(patterns, i, line, len, from, eflags, &m);
+      if (cache) cache[i] = found ? m : (regmatch_t){-1, -1};
+    }
+    if (found && (best_i < 0 || m.rm_so < best->rm_so ||
+                  (m.rm_so == best->rm_so && m.rm_eo > best->rm_eo))) {
+      *best = m;
+      best_i = i;
+    }
+  }
+
+  return best_i;
+}
+
+static regmatch_t *new_cache(const s21g_patterns *patterns) {
+  regmatch_t *cache = malloc((patterns->count ? patterns->count : 1) * sizeof(regmatch_t));
+
+  for (int i = 0; cache && i < patterns->count; i++) cache[i].rm_so = -2;
+
+  return cache;
+}
+
+int s21g_match_line(const s21g_patterns *patterns, const char *line,
+                    size_t len, size_t from, size_t *so, size_t *eo) {
+  regmatch_t m;
+  int i = from <= len ? first_line_match(patterns, line, len, from, 0, &m, NULL) : -1;
+
+  if (i >= 0) {
+    *so = m.rm_so;
+    *eo = m.rm_eo;
+  }
+
+  return i;
+}
+
+static void emit(s21g_search *search, const char *buffer, size_t ls,
+                 size_t le, size_t *counted, size_t so, size_t eo, int i) {
+  s21g_match match;
+
+  // line numbers are only counted up to the lines that get reported
+  if (search->mode & S21G_LINE_NUMBERS) {
+    search->line_number += s21_count_newlines(buffer + *counted, ls - *counted);
+    *counted = ls;
+  }
+  match.filename = search->filename;
+  match.line_number = search->line_number + 1;
+  match.offset = search->offset + ls;
+  match.line = buffer + ls;
+  match.line_len = le - ls;
+  match.so = so;
+  match.eo = eo;
+  match.pattern = i;
+  match.continued = 0;
+  match.more = 0;
+  if (search->callback && search->callback(&match, search->data))
+    search->stopped = 1;
+}
+
+// Emits the lines of buffer[from, to) as inverted (non-matching) lines;
+// to is just past a newline or the end of the buffer. Without a callback
+// or with S21G_SPANS the run is counted in one pass and, when there is a
+// callback, handed over whole instead of line by line.
+static void emit_gap(s21g_search *search, const char *buffer, size_t from,
+                     size_t to, size_t *counted) {
+  size_t end = to > from && buffer[to - 1] == '\n' ? to - 1 : to;
+
+  if (from < to && (!search->callback || ((search->mode & S21G_SPANS) &&
+                                          !(search->mode & S21G_LINE_NUMBERS)))) {
+    search->selected += s21_count_newlines(buffer + from, end - from) + 1;
+    if (search->callback) emit(search, buffer, from, end, counted, 0, 0, -1);
+    from = to;
+  }
+  while (!search->stopped && from < to) {
+    const char *nl = s21_find_newline(buffer + from, to - from);
+    size_t le = nl ? (size_t)(nl - buffer) : to;
+    search->selected++;
+    emit(search, buffer, from, le, counted, 0, 0, -1);
+    from = le + 1;
+  }
+}
+
+// Verifies a candidate line found by the block search and emits it. When
+// a block match lies inside the line, an inverted search without -w/-x
+// knows the line matches and skips it without another regexec.
+static void select_line(s21g_search *search, const char *buffer, size_t ls,
+                        size_t le, size_t end, int inside, regmatch_t *cache,
+                        size_t *counted) {
+  const char *line = buffer + ls;
+  size_t len = le - ls, from = 0;
+  regmatch_t m;
+  int i;
+
+  if ((search->mode & S21G_INVERT) && inside &&
+      !(search->patterns->flags & (S21G_WORD | S21G_LINE)))
+    return;
+  for (int p = 0; cache && p < search->patterns->count; p++) cache[p].rm_so = -2;
+  i = first_line_match(search->patterns, line, len, 0, 0, &m, cache);
+  if (search->mode & S21G_INVERT) {
+    if (i < 0) emit_gap(search, buffer, ls, le < end ? le + 1 : le, counted);
+  } else if (i >= 0) {
+    search->selected++;
+    if (!(search->mode & S21G_EACH_MATCH)) {
+      emit(search, buffer, ls, le, counted, m.rm_so, m.rm_eo, i);
+    } else {
+      while (!search->stopped && i >= 0) {
+        if (m.rm_eo > m.rm_so)
+          emit(search, buffer, ls, le, counted, m.rm_so, m.rm_eo, i);
+        // empty matches must still move forward
+        from = m.rm_eo > m.rm_so ? (size_t)m.rm_eo : (size_t)m.rm_eo + 1;
+        i = from <= len ? first_line_match(search->patterns, line, len, from, 0, &m, cache) : -1;
+      }
+    }
+  }
+}
+
+// Matches of pattern i in line[from, len), non-empty ones only, as -o
+// counts them.
+static long count_matches(const s21g_patterns *patterns, int i, const char *line,
+                          size_t len, size_t from, int eflags, size_t accept) {
+  long count = 0;
+  regmatch_t m;
+
+  while (from <= len && line_match(patterns, i, line, len, from, eflags, &m) &&
+         (size_t)m.rm_so < accept) {
+    count += m.rm_eo > m.rm_so;
+    from = m.rm_eo > m.rm_so ? (size_t)m.rm_eo : (size_t)m.rm_eo + 1;
+  }
+
+  return count;
+}
+
+// S21G_PER_PATTERN over whole lines. Each pattern runs over the block on
+// its own and jumps from a match to the next line, so the block is read
+// once per pattern however many lines match; a line is verified only when
+// the block match leaves it or -w/-x apply.
+static void count_patterns(s21g_search *search, const char *buffer, size_t len) {
+  const s21g_patterns *patterns = search->patterns;
+  int verify = patterns->flags & (S21G_WORD | S21G_LINE);
+  size_t limit = (len && buffer[len - 1] != '\n') ? len + 1 : len;
+  long lines = 0;
+
+  if (search->mode & S21G_INVERT)
+    lines = s21_count_newlines(buffer, len) + (limit > len);
+  for (int i = 0; i < patterns->count; i++) {
+    size_t pos = 0;
+    long count = 0;
+    regmatch_t m = {0, len};
+    while (pos < limit && !block_exec(patterns, i, buffer, &m) && (size_t)m.rm_so < limit) {
+      const char *nl = memrchr(buffer + pos, '\n', m.rm_so - pos);
+      size_t ls = nl ? (size_t)(nl - buffer) + 1 : pos, le = len;
+      if ((nl = s21_find_newline(buffer + ls, len - ls))) le = nl - buffer;
+      if (search->mode & S21G_EACH_MATCH)
+        count += count_matches(patterns, i, buffer + ls, le - ls, 0, 0, le - ls + 1);
+      else if (!verify && (size_t)m.rm_eo <= le)
+        count++;
+      else
+        count += line_match(patterns, i, buffer + ls, le - ls, 0, 0, &m);
+      // the search goes on from the next line
+      pos = le + 1;
+      m = (regmatch_t){pos, len};
+    }
+    if (search->mode & S21G_INVERT) count = lines - count;
+    search->counts[i] += count;
+    search->selected += count;
+  }
+  search->offset += len;
+}
+
+// buffer must hold whole lines; only the last chunk of an input may end
+// without a newline. Each pattern runs over the whole block (REG_NEWLINE
+// keeps matches inside lines), so lines without a candidate are skipped
+// without calling regexec on them.
+long s21g_search_buffer(s21g_search *search, const char *buffer,
+                        size_t len) {
+  const s21g_patterns *patterns = search->patterns;
+  size_t limit = (len && buffer[len - 1] != '\n') ? len + 1 : len;
+  size_t pos = 0, counted = 0;
+
+  match_error = 0;
+  if (search->mode & S21G_PER_PATTERN) {
+    count_patterns(search, buffer, len);
+    return match_error ? search_failed(search, match_error) : search->selected;
+  }
+
+  // next[i] is where pattern i matches next, next[count + i] where it ends
+  long *next = malloc((patterns->count ? patterns->count : 1) * 2 * sizeof(long));
+  regmatch_t *cache = NULL;
+  int inside;
+
+  if ((search->mode & S21G_EACH_MATCH) && !(cache = new_cache(patterns))) {
+    free(next);
+    next = NULL;
+  }
+  for (int i = 0; next && i < patterns->count; i++) next[i] = -2;
+
+  while (next && !search->stopped && !match_error && pos < len) {
+    size_t candidate = limit;
+    for (int i = 0; i < patterns->count; i++) {
+      if (next[i] != -1 && next[i] < (long)pos) {
+        regmatch_t m = {pos, len};
+        next[i] = block_exec(patterns, i, buffer, &m) ? -1 : m.rm_so;
+        next[patterns->count + i] = m.rm_eo;
+      }
+      if (next[i] >= 0 && (size_t)next[i] < candidate) candidate = next[i];
+    }
+
+    size_t ls = pos, le = len;
+    if (candidate < limit) {
+      const char *nl = memrchr(buffer + pos, '\n', candidate - pos);
+      if (nl) ls = nl - buffer + 1;
+      nl = s21_find_newline(buffer + ls, len - ls);
+      if (nl) le = nl - buffer;
+    } else {
+      ls = len;
+    }
+
+    // a match list like [[:space:]] can run past the newline, so only a
+    // block match that ends inside the line proves the line matches
+    inside = 0;
+    for (int i = 0; i < patterns->count && !inside; i++)
+      inside = next[i] >= 0 && (size_t)next[i] <= le && (size_t)next[patterns->count + i] <= le;
+
+    if (search->mode & S21G_INVERT) emit_gap(search, buffer, pos, ls, &counted);
+    if (!search->stopped && ls < len)
+      select_line(search, buffer, ls, le, len, inside, cache, &counted);
+    pos = le + 1;
+  }
+
+  if (!next || match_error) search_failed(search, next ? match_error : ENOMEM);
+  free(next);
+  free(cache);
+  if (search->mode & S21G_LINE_NUMBERS)
+    search->line_number += s21_count_newlines(buffer + counted, len - counted);
+  search->offset += len;
+
+  return search->selected;
+}
+
+void s21g_stream_init(s21g_stream *stream) {
+  memset(stream, 0, sizeof(*stream));
+  stream->fd = -1;
+  stream->spill = -1;
+  stream->max_line = S21G_MAX_LINE;
+}
+
+void s21g_stream_free(s21g_stream *stream) {
+  size_t max_line = stream->max_line;
+
+  s21g_stream_reset(stream);
+  free(stream->buffer);
+  free(stream->replay);
+  free(stream->seen);
+  s21g_stream_init(stream);
+  stream->max_line = max_line;
+}
+
+// Leaves the long line, if any.
+static void stream_end_line(s21g_stream *stream) {
+  if (stream->spill >= 0) close(stream->spill);
+  stream->spill = -1;
+  stream->spilled = 0;
+  stream->long_line = 0;
+}
+
+static void emit_fragment(s21g_search *search, s21g_stream *stream,
+                          const char *data, size_t len, long long offset,
+                          int more) {
+  s21g_match match = {search->filename, search->line_number + 1, offset, data,
+                      len, 0, 0, -1, stream->emitted, more};
+
+  stream->emitted = 1;
+  if (search->callback(&match, search->data)) search->stopped = 1;
+}
+
+// Emits bytes [from, to) of the current long line as fragments. Bytes that
+// already left the window are read back from the spill, else from the
+// input with pread; if that fails only the buffered part is emitted.
+static void emit_range(s21g_search *search, s21g_stream *stream,
+                       long long from, long long to, int last) {
+  long long window = search->offset;
+
+  while (!search->stopped && from < to) {
+    const char *data = stream->buffer + (from - window);
+    size_t n = to - from;
+    if (from < window) {
+      n = window - from < S21G_BLOCK_SIZE ? window - from : S21G_BLOCK_SIZE;
+      if (!stream->replay && (stream->replay = malloc(S21G_BLOCK_SIZE + 1)))
+        stream->replay[S21G_BLOCK_SIZE] = '\0';
+      int fd = stream->spill >= 0 ? stream->spill : stream->fd;
+      long long at = stream->spill >= 0 ? from - stream->line_start : from;
+      if (fd < 0 || !stream->replay || pread(fd, stream->replay, n, at) != (ssize_t)n) {
+        from = window;
+        continue;
+      }
+      data = stream->replay;
+    }
+    emit_fragment(search, stream, data, n, from, !(last && from + (long long)n == to));
+    from += n;
+  }
+  stream->emitted_to = to;
+}
+
+// S21G_PER_PATTERN for one window of a long line; stream->seen keeps
+// which patterns already matched the line in an earlier window.
+static void count_window(s21g_search *search, s21g_stream *stream, size_t end,
+                         int final, size_t first, int eflags, size_t accept) {
+  const s21g_patterns *patterns = search->patterns;
+  int invert = search->mode & S21G_INVERT;
+  regmatch_t m;
+
+  if (!stream->seen && !(stream->seen = calloc(patterns->count ? patterns->count : 1, 1))) {
+    search_failed(search, ENOMEM);
+    return;
+  }
+  for (int i = 0; i < patterns->count; i++) {
+    long count = 0;
+    if ((search->mode & S21G_EACH_MATCH) && !invert) {
+      count = count_matches(patterns, i, stream->buffer, end, first, eflags, accept);
+    } else if (!stream->seen[i] &&
+               line_match(patterns, i, stream->buffer, end, first, eflags, &m) &&
+               (size_t)m.rm_so < accept) {
+      stream->seen[i] = 1;
+      count = !invert;
+    }
+    if (final) {
+      if (invert && !stream->seen[i]) count = 1;
+      stream->seen[i] = 0;
+    }
+    search->counts[i] += count;
+    search->selected += count;
+  }
+}
+
+// Searches one window of a line longer than max_line: buffer[0, end)
+// holds the newest bytes of the line, the last S21G_WINDOW_OVERLAP of
+// which are kept for the next window unless final. Matches are taken when
+// they start before the overlap, so none is reported twice and matches up
+// to the overlap length are found across window borders. After the first
+// window buffer[0] was taken with the window before and is only the left
+// context of the search, for -w, \< and \b.
+static void long_window(s21g_search *search, s21g_stream *stream, size_t end,
+                        int final) {
+  const s21g_patterns *patterns = search->patterns;
+  const char *buffer = stream->buffer;
+  size_t accept = final ? end + 1 : end - S21G_WINDOW_OVERLAP + 1;
+  size_t first = search->offset > stream->line_start, from = first;
+  int eflags = (first ? REG_NOTBOL : 0) | (final ? 0 : REG_NOTEOL);
+  int invert = search->mode & S21G_INVERT, i;
+  regmatch_t m, *cache;
+
+  if (search->mode & S21G_PER_PATTERN) {
+    count_window(search, stream, end, final, first, eflags, accept);
+    return;
+  }
+  if ((search->mode & S21G_EACH_MATCH) && !invert) {
+    if (!(cache = new_cache(patterns))) search->stopped = 1;
+    while (!search->stopped && from <= end &&
+           (i = first_line_match(patterns, buffer, end, from, eflags, &m, cache)) >= 0 &&
+           (size_t)m.rm_so < accept) {
+      if (!stream->line_matched) search->selected++;
+      stream->line_matched = 1;
+      if (m.rm_eo > m.rm_so && search->callback) {
+        s21g_match match = {search->filename, search->line_number + 1,
+                            search->offset + m.rm_so, buffer + m.rm_so,
+                            m.rm_eo - m.rm_so, 0, m.rm_eo - m.rm_so, i, 0, 0};
+        if (search->callback(&match, search->data)) search->stopped = 1;
+      }
+      from = m.rm_eo > m.rm_so ? (size_t)m.rm_eo : (size_t)m.rm_eo + 1;
+    }
+    free(cache);
+  } else if (!stream->line_matched) {
+    i = first_line_match(patterns, buffer, end, first, eflags, &m, NULL);
+    stream->line_matched = i >= 0 && (size_t)m.rm_so < accept;
+    if (stream->line_matched && !invert) search->selected++;
+  }
+
+  long long to = search->offset + (final ? end : end - S21G_WINDOW_OVERLAP);
+  if (!(search->mode & S21G_EACH_MATCH) && search->callback &&
+      stream->line_matched != invert && (!invert || final))
+    emit_range(search, stream, stream->emitted_to, to, final);
+  if (final && invert && !stream->line_matched) search->selected++;
+}
+
+// A long line goes to an unlinked file when it's searched whole or may be
+// printed from an input that can't be read back.
+static int spill_open(s21g_search *search, s21g_stream *stream) {
+  const char *dir = getenv("TMPDIR");
+  char path[4096];
+
+  if (!stream->whole && (!search->callback || (search->mode & S21G_EACH_MATCH) ||
+                         (stream->fd >= 0 && lseek(stream->fd, 0, SEEK_CUR) >= 0)))
+    return 1;
+  snprintf(path, sizeof(path), "%s/s21_grep.XXXXXX", dir && *dir ? dir : "/tmp");
+  if ((stream->spill = mkstemp(path)) >= 0) unlink(path);
+
+  return stream->spill >= 0;
+}
+
+static int spill_write(s21g_stream *stream, const char *data, size_t len) {
+  ssize_t n = 0;
+
+  while (len && (n = write(stream->spill, data, len)) > 0) {
+    data += n;
+    len -= n;
+    stream->spilled += n;
+  }
+
+  return !len;
+}
+
+// Searches the spilled long line as one line. The mapping ends in a NUL
+// for the same reason stream buffers do (see stream_prepare).
+static int search_spilled(s21g_search *search, s21g_stream *stream) {
+  long long offset = search->offset;
+  char *line;
+
+  if (!spill_write(stream, "", 1)) return 0;
+  line = mmap(NULL, stream->spilled, PROT_READ, MAP_PRIVATE, stream->spill, 0);
+  if (line == MAP_FAILED) return 0;
+  if (stream->spilled > stream->whole_peak) stream->whole_peak = stream->spilled;
+  search->offset = stream->line_start;
+  s21g_search_buffer(search, line, stream->spilled - 1);
+  search->offset = offset;
+  munmap(line, stream->spilled);
+
+  return 1;
+}
+
+// Searches what the buffer holds and makes room for more input: complete
+// lines go to s21g_search_buffer, a line that fills max_line is
+// searched window by window, or spilled and searched whole at its end.
+static int stream_process(s21g_search *search, s21g_stream *stream) {
+  const char *last;
+  char *grown;
+  int result = 1;
+
+  if (stream->long_line) {
+    const char *nl = s21_find_newline(stream->buffer, stream->used);
+    size_t end = nl ? (size_t)(nl - stream->buffer) : stream->used;
+    size_t done = nl ? end + 1 : stream->whole ? end : end - S21G_WINDOW_OVERLAP;
+    if (nl || stream->used == stream->cap) {
+      if (!stream->whole) long_window(search, stream, end, nl != NULL);
+      // the spill gets the bytes of the line as they leave the buffer
+      if (stream->spill >= 0) result = spill_write(stream, stream->buffer, nl ? end : done);
+      if (result && nl && stream->whole) result = search_spilled(search, stream);
+      memmove(stream->buffer, stream->buffer + done, stream->used - done);
+      stream->used -= done;
+      search->offset += done;
+    }
+    if (nl) {
+      stream_end_line(stream);
+      if (search->mode & S21G_LINE_NUMBERS) search->line_number++;
+    }
+  }
+
+  if (!stream->long_line && (last = memrchr(stream->buffer, '\n', stream->used))) {
+    size_t done = last - stream->buffer + 1;
+    s21g_search_buffer(search, stream->buffer, done);
+    memmove(stream->buffer, stream->buffer + done, stream->used - done);
+    stream->used -= done;
+  } else if (!stream->long_line && stream->used == stream->cap &&
+             stream->cap < stream->max_line) {
+    size_t cap = stream->cap * 2 < stream->max_line ? stream->cap * 2 : stream->max_line;
+    if ((grown = realloc(stream->buffer, cap + 1))) {
+      stream->buffer = grown;
+      stream->buffer[cap] = '\0';
+      stream->cap = cap;
+    } else {
+      result = 0;
+    }
+  } else if (!stream->long_line && stream->used == stream->cap) {
+    stream->long_line = 1;
+    stream->whole = search->patterns->whole_lines;
+    stream->line_start = stream->emitted_to = search->offset;
+    stream->line_matched = stream->emitted = 0;
+    result = spill_open(search, stream) && stream_process(search, stream);
+  }
+
+  return result;
+}
+
+// Stream buffers hold a NUL past cap: some regexec implementations, ASan's
+// interceptor among them, read the subject up to a NUL despite REG_STARTEND.
+static int stream_prepare(s21g_stream *stream) {
+  if (!stream->buffer && (stream->buffer = malloc(S21G_BLOCK_SIZE + 1))) {
+    stream->buffer[S21G_BLOCK_SIZE] = '\0';
+    stream->cap = S21G_BLOCK_SIZE;
+  }
+
+  return stream->buffer != NULL;
+}
+
+long s21g_stream_read(s21g_search *search, s21g_stream *stream, int fd) {
+  ssize_t n = stream_prepare(stream) ? 0 : -1;
+
+  stream->fd = fd;
+  while (n >= 0 && !search->stopped &&
+         (n = read(fd, stream->buffer + stream->used, stream->cap - stream->used)) > 0) {
+    stream->used += n;
+    if (!stream_process(search, stream)) n = -1;
+  }
+
+  return n < 0 ? search_failed(search, errno) : search->selected;
+}
+
+long s21g_stream_feed(s21g_search *search, s21g_stream *stream,
+                      const char *data, size_t len) {
+  const char *last = memrchr(data, '\n', len);
+  int result = stream_prepare(stream);
+
+  // lines that are whole in data are searched in place
+  if (result && !stream->used && !stream->long_line && last) {
+    s21g_search_buffer(search, data, last - data + 1);
+    len -= last - data + 1;
+    data = last + 1;
+  }
+  while (result && len && !search->stopped) {
+    size_t n = stream->cap - stream->used < len ? stream->cap - stream->used : len;
+    memcpy(stream->buffer + stream->used, data, n);
+    stream->used += n;
+    data += n;
+    len -= n;
+    result = stream_process(search, stream);
+  }
+
+  return result ? search->selected : search_failed(search, errno);
+}
+
+long s21g_stream_finish(s21g_search *search, s21g_stream *stream) {
+  int result = 1;
+
+  if (stream->long_line && !search->stopped) {
+    if (!stream->whole)
+      long_window(search, stream, stream->used, 1);
+    else
+      result = spill_write(stream, stream->buffer, stream->used) && search_spilled(search, stream);
+    search->offset += stream->used;
+    if (search->mode & S21G_LINE_NUMBERS) search->line_number++;
+  } else if (stream->used && !search->stopped) {
+    s21g_search_buffer(search, stream->buffer, stream->used);
+  }
+  if (!result) search_failed(search, errno);
+  s21g_stream_reset(stream);
+
+  return search->selected;
+}
+
+void s21g_stream_reset(s21g_stream *stream) {
+  stream->used = 0;
+  stream->fd = -1;
+  stream_end_line(stream);
+  free(stream->seen);
+  stream->seen = NULL;
+}
+
+long s21g_search_fd(s21g_search *search, int fd) {
+  s21g_stream stream;
+  long result;
+
+  s21g_stream_init(&stream);
+  if ((result = s21g_stream_read(search, &stream, fd)) >= 0)
+    result = s21g_stream_finish(search, &stream);
+  s21g_stream_free(&stream);
+
+  return result;
+}
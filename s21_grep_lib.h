@@ -0,0 +1,158 @@
+#ifndef S21_GREP_LIB_H
+#define S21_GREP_LIB_H
+
+#include <regex.h>
+#include <stddef.h>
+
+// libs21grep: compile patterns once, then search buffers or file
+// descriptors and receive one callback per selected line (or per match).
+// A compiled s21g_patterns is never modified by a search, so it can be
+// shared between threads; all per-search state lives in s21g_search.
+
+#define S21G_BLOCK_SIZE 65536
+
+// Lines longer than a stream's max_line (S21G_MAX_LINE unless the caller
+// lowers it, never below S21G_BLOCK_SIZE) are searched in windows of that
+// size that overlap by S21G_WINDOW_OVERLAP bytes, so memory stays bounded
+// on inputs without newlines. Matches longer than the overlap can be missed
+// at a window border. ^ and $ are kept to the line's ends with REG_NOTBOL
+// and REG_NOTEOL, so anchored and -x sets whose matches all fit in the
+// overlap are windowed exactly. The others (and -P) need the whole line:
+// it is copied to an unlinked file in $TMPDIR (else /tmp) and searched
+// from a mapping when it ends. That mapping, and the file itself where
+// $TMPDIR is a tmpfs, take memory for the whole line, outside the callers'
+// budgets. A line that may be printed goes to such a file too when the
+// input can't be read back (a pipe); only a block of it is read back at a
+// time.
+#define S21G_MAX_LINE (1 << 20)
+#define S21G_WINDOW_OVERLAP 4096
+
+// pattern sets at least this many per thread are compiled in parallel
+#define S21G_PATTERNS_PER_THREAD 256
+#define S21G_MAX_THREADS 64
+
+// pattern flags
+#define S21G_ICASE 1
+#define S21G_WORD 2
+#define S21G_LINE 4
+// Perl syntax through PCRE2 with JIT; s21g_compile fails with it unless the
+// library was built with HAVE_PCRE2
+#define S21G_PERL 8
+// The caller's locale is UTF-8 (for regcomp to compile the patterns in).
+// Lines that are all ASCII are then searched with a single-byte compile of
+// every ASCII pattern, and -w decodes the characters around a match.
+#define S21G_UTF8 16
+// how much of a span is checked for non-ASCII bytes at a time, and the
+// shortest ASCII run searched on its own between lines that are not ASCII
+#define S21G_ASCII_WINDOW 4096
+#define S21G_ASCII_RUN 256
+
+// search modes
+#define S21G_INVERT 1
+#define S21G_EACH_MATCH 2
+#define S21G_LINE_NUMBERS 4  // without it line_number is reported as 0
+// With S21G_INVERT and without S21G_LINE_NUMBERS, a run of non-matching
+// lines may be reported in one callback: line then spans them all, with
+// the newlines between them but not the last one.
+#define S21G_SPANS 8
+// No callbacks: search->counts[i] gets the lines pattern i matches (with
+// S21G_EACH_MATCH its matches, with S21G_INVERT the lines it doesn't
+// match), each pattern counted on its own; selected is their sum.
+#define S21G_PER_PATTERN 16
+
+typedef struct {
+  regex_t *templates;
+  void **perl;  // pcre2_code per pattern instead, with S21G_PERL
+  char **literals;  // the text of patterns without metacharacters, else NULL
+  size_t *literal_lens;  // and its length, set with literals
+  regex_t **ascii;  // S21G_UTF8: the C locale compile of ASCII patterns
+  int count;
+  int flags;
+  int whole_lines;  // long lines must be searched whole, see S21G_MAX_LINE
+} s21g_patterns;
+
+typedef struct {
+  const char *filename;
+  long line_number;
+  long long offset;  // byte offset of line[0] in the input
+  const char *line;  // not NUL-terminated, no trailing newline
+  size_t line_len;
+  size_t so;  // match span inside line, 0 0 for inverted lines
+  size_t eo;
+  int pattern;  // index of the matching pattern, -1 for inverted lines
+  // A windowed line (see S21G_MAX_LINE) comes in several callbacks: all but
+  // the first have continued set, all but the last have more set.
+  int continued;
+  int more;
+} s21g_match;
+
+// Returning nonzero stops the search (e.g. -l needs one line per file).
+typedef int (*s21g_callback)(const s21g_match *match, void *data);
+
+typedef struct {
+  const s21g_patterns *patterns;
+  int mode;
+  s21g_callback callback;
+  void *data;
+  const char *filename;
+  long line_number;  // lines consumed before the current buffer
+  long long offset;  // bytes consumed before the current buffer
+  long selected;
+  long *counts;  // one per pattern with S21G_PER_PATTERN, zeroed by reset
+  int stopped;
+  // Why a search returned -1: an errno value, or below zero a pcre2_match
+  // error such as its match or depth limit (see s21g_strerror).
+  int error;
+} s21g_search;
+
+// Carries an unfinished last line between reads of a growing input. The
+// buffer only grows, so cap is also its high-water mark.
+typedef struct {
+  char *buffer;
+  size_t cap;
+  size_t used;
+  size_t max_line;  // cap never grows past it
+  int fd;  // where a long line is read back from, -1 when fed by the caller
+  char *replay;
+  int long_line;  // buffer holds a window of a line over max_line
+  int whole;  // the long line is searched whole when it ends
+  int spill;  // temporary file holding what left the buffer, else -1
+  size_t spilled;
+  size_t whole_peak;  // the longest line mapped to be searched whole
+  long long line_start;
+  long long emitted_to;
+  int line_matched;
+  int emitted;
+  unsigned char *seen;  // per pattern: matched the long line, S21G_PER_PATTERN
+} s21g_stream;
+
+int s21g_compile(s21g_patterns *patterns, char **sources, int count,
+                 int flags, char *error, size_t error_size);
+void s21g_free(s21g_patterns *patterns);
+
+// Leftmost-longest match of any pattern in line[from, len), with -w/-x
+// applied, for callers that want every match of a selected line. Returns
+// the pattern index or -1.
+int s21g_match_line(const s21g_patterns *patterns, const char *line,
+                    size_t len, size_t from, size_t *so, size_t *eo);
+
+void s21g_search_init(s21g_search *search, const s21g_patterns *patterns,
+                      int mode, s21g_callback callback, void *data);
+void s21g_search_reset(s21g_search *search, const char *filename);
+long s21g_search_buffer(s21g_search *search, const char *buffer,
+                        size_t len);
+long s21g_search_fd(s21g_search *search, int fd);
+const char *s21g_strerror(int error);
+
+// s21g_stream_read searches fd up to its current end (s21g_stream_feed: a
+// chunk the caller already read) but keeps a last line without newline
+// buffered; s21g_stream_finish searches that line too.
+void s21g_stream_init(s21g_stream *stream);
+void s21g_stream_free(s21g_stream *stream);
+void s21g_stream_reset(s21g_stream *stream);
+long s21g_stream_read(s21g_search *search, s21g_stream *stream, int fd);
+long s21g_stream_feed(s21g_search *search, s21g_stream *stream,
+                      const char *data, size_t len);
+long s21g_stream_finish(s21g_search *search, s21g_stream *stream);
+
+#endif
@@ -0,0 +1,239 @@
+#include "s21_grep.h"
+
+#include "s21_simd.h"
+
+// Output formatting. Lines, -Z names and --json objects are written into
+// the output stream's own buffer with the unlocked stdio calls: no format
+// string is parsed per line, and the order against the few printf'd
+// messages holds.
+
+// where this thread writes: stdout and stderr, or a daemon client's
+static __thread FILE *output, *errors;
+
+void set_streams(FILE *output_to, FILE *errors_to) {
+  output = output_to;
+  errors = errors_to;
+}
+
+FILE *output_stream(void) { return output ? output : stdout; }
+
+FILE *error_stream(void) { return errors ? errors : stderr; }
+
+static void put(const char *text, size_t len) {
+  fwrite_unlocked(text, 1, len, output_stream());
+}
+
+static void put_string(const char *text) { put(text, strlen(text)); }
+
+static void put_number(unsigned long long number) {
+  char digits[24], *p = digits + sizeof(digits);
+
+  do *--p = '0' + number % 10;
+  while (number /= 10);
+  put(p, digits + sizeof(digits) - p);
+}
+
+static void put_filename(const char *filename, const flags *options) {
+  put_string(filename);
+  putc_unlocked(options->null ? '\0' : ':', output_stream());
+}
+
+// A JSON string body; runs that need no escaping are written whole. Valid
+// UTF-8 is written as is and a byte that isn't stands as U+FFFD, so the
+// text is always valid; put_json_field then adds the exact bytes. Returns
+// how many bytes were replaced.
+static size_t put_json(const char *text, size_t len) {
+  static const char hex[] = "0123456789abcdef";
+  const unsigned char *s = (const unsigned char *)text;
+  size_t run = 0, i = 0, n, replaced = 0;
+
+  while (i < len) {
+    unsigned char c = s[i];
+    if (c >= 0x20 && c != '"' && c != '\\' &&
+        (c < 0x80 || (n = s21_utf8_length(s + i, len - i)))) {
+      i += c < 0x80 ? 1 : n;
+      continue;
+    }
+    put(text + run, i - run);
+    if (c == '"' || c == '\\') {
+      putc_unlocked('\\', output_stream());
+      putc_unlocked(c, output_stream());
+    } else if (c == '\n') {
+      put("\\n", 2);
+    } else if (c == '\t') {
+      put("\\t", 2);
+    } else if (c >= 0x80) {
+      put("\\ufffd", 6);
+      replaced++;
+    } else {
+      char escape[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+      put(escape, sizeof(escape));
+    }
+    run = ++i;
+  }
+  put(text + run, len - run);
+
+  return replaced;
+}
+
+// Base64 that can be written in pieces: up to two bytes wait for the next
+// piece, and a call with final set writes them out padded.
+static void put_base64(const char *data, size_t len, int final) {
+  static const char digits[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  static __thread unsigned char rest[2];
+  static __thread int kept;
+  const unsigned char *s = (const unsigned char *)data;
+  char quad[4];
+
+  for (size_t i = 0; i < len; i++) {
+    if (kept < 2) {
+      rest[kept++] = s[i];
+      continue;
+    }
+    quad[0] = digits[rest[0] >> 2];
+    quad[1] = digits[(rest[0] & 3) << 4 | rest[1] >> 4];
+    quad[2] = digits[(rest[1] & 15) << 2 | s[i] >> 6];
+    quad[3] = digits[s[i] & 63];
+    put(quad, 4);
+    kept = 0;
+  }
+  if (final && kept) {
+    quad[0] = digits[rest[0] >> 2];
+    quad[1] = digits[(rest[0] & 3) << 4 | (kept > 1 ? rest[1] >> 4 : 0)];
+    quad[2] = kept > 1 ? digits[(rest[1] & 15) << 2] : '=';
+    quad[3] = '=';
+    put(quad, 4);
+    kept = 0;
+  }
+}
+
+// "key":"text", followed by "key_bytes":"base64" when the text is not
+// UTF-8 and had bytes replaced, so names and lines come back exactly.
+static void put_json_field(const char *key, const char *text, size_t len) {
+  putc_unlocked('"', output_stream());
+  put_string(key);
+  put_string("\":\"");
+  if (put_json(text, len)) {
+    put_string("\",\"");
+    put_string(key);
+    put_string("_bytes\":\"");
+    put_base64(text, len, 1);
+  }
+  putc_unlocked('"', output_stream());
+}
+
+// {"file":...,"line":...,"offset":...,"text":...,"matches":[[so,eo],...]}
+// with every non-empty match of the line. A line over max_line comes in
+// fragments that can't be checked for UTF-8 ahead of writing them, so it
+// is given only as "text_bytes", joined, and without spans.
+static void print_json_line(const s21g_match *match, const flags *options) {
+  size_t so = match->so, eo = match->eo, from;
+  int i = match->pattern, first = 1;
+
+  if (!match->continued) {
+    putc_unlocked('{', output_stream());
+    put_json_field("file", match->filename, strlen(match->filename));
+    put_string(",\"line\":");
+    put_number(match->line_number);
+    put_string(",\"offset\":");
+    put_number(match->offset);
+    putc_unlocked(',', output_stream());
+    if (match->more) put_string("\"text_bytes\":\"");
+  }
+  if (match->continued || match->more) {
+    put_base64(match->line, match->line_len, !match->more);
+    if (!match->more) putc_unlocked('"', output_stream());
+  } else {
+    put_json_field("text", match->line, match->line_len);
+  }
+  if (!match->more) {
+    put_string(",\"matches\":[");
+    while (!match->continued && i >= 0) {
+      if (eo > so) {
+        if (!first) putc_unlocked(',', output_stream());
+        putc_unlocked('[', output_stream());
+        put_number(so);
+        putc_unlocked(',', output_stream());
+        put_number(eo);
+        putc_unlocked(']', output_stream());
+        first = 0;
+      }
+      from = eo > so ? eo : eo + 1;
+      i = s21g_match_line(options->patterns, match->line, match->line_len, from, &so, &eo);
+    }
+    put_string("]}\n");
+  }
+}
+
+int print_line(const s21g_match *match, void *data) {
+  flags *options = data;
+
+  if (options->json && !options->c && !options->l) {
+    print_json_line(match, options);
+  } else if (!options->c && !options->l && !(options->o && options->v)) {
+    // -ov prints nothing, like GNU grep
+    if (!match->continued && !options->h) put_filename(match->filename, options);
+    if (!match->continued && options->n) {
+      put_number(match->line_number);
+      putc_unlocked(':', output_stream());
+    }
+    // offset is where the line starts; -o reports where the match does
+    if (!match->continued && options->b) {
+      put_number(match->offset + (options->o ? match->so : 0));
+      putc_unlocked(':', output_stream());
+    }
+    if (options->o)
+      put(match->line + match->so, match->eo - match->so);
+    else
+      put(match->line, match->line_len);
+    if (!match->more) putc_unlocked('\n', output_stream());
+  }
+
+  // -l only needs to know that one line was selected
+  return options->l;
+}
+
+// --count-by-pattern: [file:]count:pattern for every pattern, zeros too,
+// or {"file":...,"pattern":...,"count":...} with --json.
+static void print_counts(const char *filename, flags options) {
+  for (int i = 0; i < options.patterns->count; i++) {
+    if (options.json) {
+      putc_unlocked('{', output_stream());
+      put_json_field("file", filename, strlen(filename));
+      putc_unlocked(',', output_stream());
+      put_json_field("pattern", options.sources[i], strlen(options.sources[i]));
+      put_string(",\"count\":");
+      put_number(options.counts[i]);
+      put_string("}\n");
+    } else {
+      if (!options.h) put_filename(filename, &options);
+      put_number(options.counts[i]);
+      putc_unlocked(':', output_stream());
+      put_string(options.sources[i]);
+      putc_unlocked('\n', output_stream());
+    }
+  }
+}
+
+void print_totals(const char *filename, long match_count, flags options) {
+  // -l wins over --count-by-pattern as it does over -c
+  if (options.by_pattern && !options.l) {
+    print_counts(filename, options);
+  } else if (options.json && (options.c || (options.l && match_count > 0))) {
+    putc_unlocked('{', output_stream());
+    put_json_field("file", filename, strlen(filename));
+    if (!options.l) {
+      put_string(",\"count\":");
+      put_number(match_count);
+    }
+    put_string("}\n");
+  } else if (!options.json && options.c && !options.l) {
+    if (!options.h) put_filename(filename, &options);
+    put_number(match_count);
+    putc_unlocked('\n', output_stream());
+  } else if (!options.json && options.l && match_count > 0) {
+    put_string(filename);
+    putc_unlocked(options.null ? '\0' : '\n', output_stream());
+  }
+}
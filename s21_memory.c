@@ -0,0 +1,36 @@
+#include "s21_memory.h"
+
+#include <stdlib.h>
+#include <sys/resource.h>
+
+int s21_parse_size(const char *text, unsigned long long *size) {
+  char *end;
+  int shift = 0, result;
+
+  *size = strtoull(text, &end, 10);
+  if (*end == 'K' || *end == 'k')
+    shift = 10;
+  else if (*end == 'M' || *end == 'm')
+    shift = 20;
+  else if (*end == 'G' || *end == 'g')
+    shift = 30;
+  if (shift) end++;
+  result = end != text && !*end && *text != '-' && *size <= (~0ULL >> shift);
+  *size <<= shift;
+
+  return result;
+}
+
+size_t s21_parse_memory(const char *text) {
+  unsigned long long size;
+
+  if (!s21_parse_size(text, &size) || size != (size_t)size) size = 0;
+
+  return size < S21_MEMORY_MIN ? 0 : size;
+}
+
+long s21_peak_rss(void) {
+  struct rusage usage;
+
+  return getrusage(RUSAGE_SELF, &usage) ? 0 : usage.ru_maxrss;
+}
@@ -0,0 +1,22 @@
+#ifndef S21_MEMORY_H
+#define S21_MEMORY_H
+
+#include <stddef.h>
+
+// Size arguments and --stats, shared by s21_grep and s21_cat. The budget caps
+// the buffers the tools size themselves; what libc or regcomp allocate on
+// their own only shows up in the peak RSS.
+
+#define S21_MEMORY_MIN (256 << 10)
+
+// A byte count with an optional K, M or G suffix (powers of 1024). Returns
+// 0 when text is not one.
+int s21_parse_size(const char *text, unsigned long long *size);
+
+// --memory=SIZE; 0 when text is not a size or less than S21_MEMORY_MIN.
+size_t s21_parse_memory(const char *text);
+
+// peak resident set size of the process in KiB
+long s21_peak_rss(void);
+
+#endif
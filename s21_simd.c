@@ -0,0 +1,326 @@
+#include "s21_simd.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define S21_SIMD_X86 1
+#endif
+
+static size_t count_scalar(const char *buffer, size_t len) {
+  size_t count = 0;
+
+  for (size_t i = 0; i < len; i++) count += buffer[i] == '\n';
+
+  return count;
+}
+
+static const char *find_scalar(const char *buffer, size_t len) {
+  const char *found = NULL;
+
+  for (size_t i = 0; !found && i < len; i++)
+    if (buffer[i] == '\n') found = buffer + i;
+
+  return found;
+}
+
+static size_t ascii_scalar(const char *buffer, size_t len) {
+  size_t i = 0;
+
+  while (i < len && !(buffer[i] & 0x80)) i++;
+
+  return i;
+}
+
+static size_t printable_scalar(const char *buffer, size_t len) {
+  size_t i = 0;
+
+  while (i < len && buffer[i] >= 0x20 && buffer[i] < 0x7f) i++;
+
+  return i;
+}
+
+#ifdef S21_SIMD_X86
+
+// Byte counters are summed with psadbw every 255 rounds, before they wrap.
+__attribute__((target("sse2"))) static size_t count_sse2(const char *buffer,
+                                                         size_t len) {
+  const __m128i nl = _mm_set1_epi8('\n');
+  size_t i = 0, count = 0;
+
+  while (i + 16 <= len) {
+    __m128i acc = _mm_setzero_si128();
+    for (int rounds = 0; rounds < 255 && i + 16 <= len; rounds++, i += 16)
+      acc = _mm_sub_epi8(
+          acc, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buffer + i)), nl));
+    __m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+    count += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+  }
+
+  return count + count_scalar(buffer + i, len - i);
+}
+
+__attribute__((target("sse2"))) static const char *find_sse2(
+    const char *buffer, size_t len) {
+  const __m128i nl = _mm_set1_epi8('\n');
+  size_t i = 0;
+  const char *found = NULL;
+
+  for (; !found && i + 16 <= len; i += 16) {
+    int mask = _mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buffer + i)), nl));
+    if (mask) found = buffer + i + __builtin_ctz(mask);
+  }
+
+  return found ? found : find_scalar(buffer + i, len - i);
+}
+
+__attribute__((target("avx2"))) static size_t count_avx2(const char *buffer,
+                                                         size_t len) {
+  const __m256i nl = _mm256_set1_epi8('\n');
+  size_t i = 0, count = 0;
+
+  while (i + 32 <= len) {
+    __m256i acc = _mm256_setzero_si256();
+    for (int rounds = 0; rounds < 255 && i + 32 <= len; rounds++, i += 32)
+      acc = _mm256_sub_epi8(
+          acc, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(buffer + i)), nl));
+    __m256i wide = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+    __m128i sums = _mm_add_epi64(_mm256_castsi256_si128(wide),
+                                 _mm256_extracti128_si256(wide, 1));
+    count += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+  }
+
+  return count + count_sse2(buffer + i, len - i);
+}
+
+__attribute__((target("avx2"))) static const char *find_avx2(
+    const char *buffer, size_t len) {
+  const __m256i nl = _mm256_set1_epi8('\n');
+  size_t i = 0;
+  const char *found = NULL;
+
+  for (; !found && i + 32 <= len; i += 32) {
+    unsigned mask = _mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(buffer + i)), nl));
+    if (mask) found = buffer + i + __builtin_ctz(mask);
+  }
+
+  return found ? found : find_sse2(buffer + i, len - i);
+}
+
+__attribute__((target("avx512bw,popcnt"))) static size_t count_avx512(
+    const char *buffer, size_t len) {
+  const __m512i nl = _mm512_set1_epi8('\n');
+  size_t i = 0, count = 0;
+
+  for (; i + 64 <= len; i += 64)
+    count += __builtin_popcountll(
+        _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(buffer + i), nl));
+
+  return count + count_avx2(buffer + i, len - i);
+}
+
+__attribute__((target("avx512bw"))) static const char *find_avx512(
+    const char *buffer, size_t len) {
+  const __m512i nl = _mm512_set1_epi8('\n');
+  size_t i = 0;
+  const char *found = NULL;
+
+  for (; !found && i + 64 <= len; i += 64) {
+    unsigned long long mask =
+        _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(buffer + i), nl);
+    if (mask) found = buffer + i + __builtin_ctzll(mask);
+  }
+
+  return found ? found : find_avx2(buffer + i, len - i);
+}
+
+// The sign bit of every byte is its non-ASCII bit. Printable bytes are the
+// ones above 0x1f and below 0x7f as signed numbers, high bytes being
+// negative.
+__attribute__((target("sse2"))) static size_t ascii_sse2(const char *buffer,
+                                                         size_t len) {
+  size_t i = 0;
+  int mask = 0;
+
+  for (; i + 16 <= len; i += 16)
+    if ((mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(buffer + i)))))
+      return i + __builtin_ctz(mask);
+
+  return i + ascii_scalar(buffer + i, len - i);
+}
+
+__attribute__((target("sse2"))) static size_t printable_sse2(
+    const char *buffer, size_t len) {
+  const __m128i low = _mm_set1_epi8(0x1f), high = _mm_set1_epi8(0x7f);
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(buffer + i));
+    int mask = _mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpgt_epi8(v, low), _mm_cmplt_epi8(v, high)));
+    if (mask != 0xffff) return i + __builtin_ctz(~mask);
+  }
+
+  return i + printable_scalar(buffer + i, len - i);
+}
+
+__attribute__((target("avx2"))) static size_t ascii_avx2(const char *buffer,
+                                                         size_t len) {
+  size_t i = 0;
+  unsigned mask;
+
+  for (; i + 32 <= len; i += 32)
+    if ((mask = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(buffer + i)))))
+      return i + __builtin_ctz(mask);
+
+  return i + ascii_sse2(buffer + i, len - i);
+}
+
+__attribute__((target("avx2"))) static size_t printable_avx2(
+    const char *buffer, size_t len) {
+  const __m256i low = _mm256_set1_epi8(0x1f), high = _mm256_set1_epi8(0x7f);
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(buffer + i));
+    unsigned mask = _mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpgt_epi8(v, low), _mm256_cmpgt_epi8(high, v)));
+    if (mask != 0xffffffffu) return i + __builtin_ctz(~mask);
+  }
+
+  return i + printable_sse2(buffer + i, len - i);
+}
+
+__attribute__((target("avx512bw"))) static size_t ascii_avx512(
+    const char *buffer, size_t len) {
+  size_t i = 0;
+  unsigned long long mask;
+
+  for (; i + 64 <= len; i += 64)
+    if ((mask = _mm512_movepi8_mask(_mm512_loadu_si512(buffer + i))))
+      return i + __builtin_ctzll(mask);
+
+  return i + ascii_avx2(buffer + i, len - i);
+}
+
+__attribute__((target("avx512bw"))) static size_t printable_avx512(
+    const char *buffer, size_t len) {
+  const __m512i low = _mm512_set1_epi8(0x1f), high = _mm512_set1_epi8(0x7f);
+  size_t i = 0;
+
+  for (; i + 64 <= len; i += 64) {
+    __m512i v = _mm512_loadu_si512(buffer + i);
+    unsigned long long mask =
+        _mm512_cmpgt_epi8_mask(v, low) & _mm512_cmplt_epi8_mask(v, high);
+    if (~mask) return i + __builtin_ctzll(~mask);
+  }
+
+  return i + printable_avx2(buffer + i, len - i);
+}
+
+#else
+
+#define count_sse2 count_scalar
+#define count_avx2 count_scalar
+#define count_avx512 count_scalar
+#define find_sse2 find_scalar
+#define find_avx2 find_scalar
+#define find_avx512 find_scalar
+#define ascii_sse2 ascii_scalar
+#define ascii_avx2 ascii_scalar
+#define ascii_avx512 ascii_scalar
+#define printable_sse2 printable_scalar
+#define printable_avx2 printable_scalar
+#define printable_avx512 printable_scalar
+
+#endif
+
+static size_t (*const count_impl[])(const char *, size_t) = {
+    count_scalar, count_sse2, count_avx2, count_avx512};
+static const char *(*const find_impl[])(const char *, size_t) = {
+    find_scalar, find_sse2, find_avx2, find_avx512};
+static size_t (*const ascii_impl[])(const char *, size_t) = {
+    ascii_scalar, ascii_sse2, ascii_avx2, ascii_avx512};
+static size_t (*const printable_impl[])(const char *, size_t) = {
+    printable_scalar, printable_sse2, printable_avx2, printable_avx512};
+
+int s21_simd_supported(int level) {
+  int result = level == S21_SIMD_SCALAR;
+
+#ifdef S21_SIMD_X86
+  __builtin_cpu_init();
+  if (level == S21_SIMD_SSE2) result = __builtin_cpu_supports("sse2");
+  if (level == S21_SIMD_AVX2) result = __builtin_cpu_supports("avx2");
+  if (level == S21_SIMD_AVX512) result = __builtin_cpu_supports("avx512bw");
+#endif
+
+  return result;
+}
+
+static int simd_level = S21_SIMD_SCALAR;
+static pthread_once_t level_once = PTHREAD_ONCE_INIT;
+
+static void find_level(void) {
+  const char *cap = getenv("S21_SIMD_LEVEL");
+  int best = cap ? atoi(cap) : S21_SIMD_AVX512;
+
+  if (best > S21_SIMD_AVX512) best = S21_SIMD_AVX512;
+  while (best > S21_SIMD_SCALAR && !s21_simd_supported(best)) best--;
+  simd_level = best < 0 ? S21_SIMD_SCALAR : best;
+}
+
+// S21_SIMD_LEVEL=0..3 in the environment caps the level, so tests can run
+// the fallbacks on any machine. Found once, whichever thread asks first.
+int s21_simd_level(void) {
+  pthread_once(&level_once, find_level);
+
+  return simd_level;
+}
+
+size_t s21_count_newlines(const char *buffer, size_t len) {
+  return count_impl[s21_simd_level()](buffer, len);
+}
+
+const char *s21_find_newline(const char *buffer, size_t len) {
+  return find_impl[s21_simd_level()](buffer, len);
+}
+
+size_t s21_count_newlines_at(int level, const char *buffer, size_t len) {
+  return count_impl[level](buffer, len);
+}
+
+const char *s21_find_newline_at(int level, const char *buffer, size_t len) {
+  return find_impl[level](buffer, len);
+}
+
+size_t s21_ascii_prefix(const char *buffer, size_t len) {
+  return ascii_impl[s21_simd_level()](buffer, len);
+}
+
+size_t s21_printable_prefix(const char *buffer, size_t len) {
+  return printable_impl[s21_simd_level()](buffer, len);
+}
+
+size_t s21_ascii_prefix_at(int level, const char *buffer, size_t len) {
+  return ascii_impl[level](buffer, len);
+}
+
+size_t s21_printable_prefix_at(int level, const char *buffer, size_t len) {
+  return printable_impl[level](buffer, len);
+}
+
+size_t s21_utf8_length(const unsigned char *text, size_t len) {
+  size_t n = text[0] >= 0xf0 ? 4 : text[0] >= 0xe0 ? 3 : 2;
+  int valid = text[0] >= 0xc2 && text[0] <= 0xf4 && n <= len;
+
+  for (size_t i = 1; valid && i < n; i++) valid = (text[i] & 0xc0) == 0x80;
+  if (valid && n == 3)
+    valid = !(text[0] == 0xe0 && text[1] < 0xa0) && !(text[0] == 0xed && text[1] >= 0xa0);
+  if (valid && n == 4)
+    valid = !(text[0] == 0xf0 && text[1] < 0x90) && !(text[0] == 0xf4 && text[1] >= 0x90);
+
+  return valid ? n : 0;
+}
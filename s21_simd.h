@@ -0,0 +1,33 @@
+#ifndef S21_SIMD_H
+#define S21_SIMD_H
+
+#include <stddef.h>
+
+// Newline and ASCII kernels shared by s21_grep and s21_cat. The best
+// variant the CPU supports is picked on the first call; the per-variant
+// entry points are exported for the benchmarks.
+
+#define S21_SIMD_SCALAR 0
+#define S21_SIMD_SSE2 1
+#define S21_SIMD_AVX2 2
+#define S21_SIMD_AVX512 3
+
+size_t s21_count_newlines(const char *buffer, size_t len);
+const char *s21_find_newline(const char *buffer, size_t len);
+// Length of the leading run of ASCII bytes (below 0x80), and of printable
+// ASCII (0x20 to 0x7e).
+size_t s21_ascii_prefix(const char *buffer, size_t len);
+size_t s21_printable_prefix(const char *buffer, size_t len);
+
+// Length of the valid UTF-8 sequence at text[0] >= 0x80, 0 if there is none:
+// no overlong forms, surrogates or code points past U+10FFFF.
+size_t s21_utf8_length(const unsigned char *text, size_t len);
+
+int s21_simd_level(void);
+int s21_simd_supported(int level);
+size_t s21_count_newlines_at(int level, const char *buffer, size_t len);
+const char *s21_find_newline_at(int level, const char *buffer, size_t len);
+size_t s21_ascii_prefix_at(int level, const char *buffer, size_t len);
+size_t s21_printable_prefix_at(int level, const char *buffer, size_t len);
+
+#endif